@@ -0,0 +1,528 @@
+/*
+ * apex_batch.c
+ * Runs many independent APEX simulations in one process on a work-stealing
+ * thread pool
+ *
+ * The manifest has one job per line:
+ *
+ *     <program.asm> <cycles> [<config>]
+ *
+ * where <cycles> has the same meaning as for the Simulate command (0 runs
+ * until HALT) and <config> selects the simulator configuration: "-" for the
+ * command line configuration, a configuration file, or comma separated
+ * <key>=<value> overrides of the command line configuration. Blank lines and
+ * lines starting with '#' are ignored.
+ *
+ * Every distinct program is parsed once and its code memory is shared by all
+ * jobs that run it. One CSV result row is printed per job, in manifest order.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* One line of the manifest and its result */
+typedef struct Batch_Job
+{
+    char program[MAX_BATCH_PATH];
+    char config[MAX_BATCH_PATH];
+    int cycles;
+    int program_index;
+
+    int status;
+    int clock;
+    int insn_completed;
+} Batch_Job;
+
+/* A parsed program shared by all jobs that run it */
+typedef struct Batch_Program
+{
+    const char *path;
+    APEX_Instruction *code_memory;
+    int code_memory_size;
+} Batch_Program;
+
+/*
+ * Per-worker deque of job indices. The owner pops from the bottom, idle
+ * workers steal from the top.
+ */
+typedef struct Batch_Deque
+{
+    pthread_mutex_t lock;
+    int *jobs;
+    int top;
+    int bottom;
+} Batch_Deque;
+
+typedef struct Batch_Context Batch_Context;
+
+typedef struct Batch_Worker
+{
+    pthread_t thread;
+    int id;
+    int jobs_run;
+    int jobs_stolen;
+    Batch_Context *ctx;
+} Batch_Worker;
+
+struct Batch_Context
+{
+    Batch_Job *jobs;
+    int num_jobs;
+    Batch_Program *programs;
+    int num_programs;
+    Batch_Deque *deques;
+    Batch_Worker *workers;
+    int num_workers;
+    const APEX_Config *config;     /* Configuration of "-" jobs */
+};
+
+#define BATCH_LOAD_ERROR 0x0
+#define BATCH_CONFIG_ERROR 0x10
+
+static const char *
+batch_status_str(int status)
+{
+    switch (status)
+    {
+        case APEX_SIM_HALTED:
+            return "halted";
+
+        case APEX_SIM_CYCLE_LIMIT:
+            return "cycle_limit";
+
+        case APEX_SIM_INSN_LIMIT:
+            return "insn_limit";
+
+        case APEX_SIM_FAULT:
+            return "fault";
+
+        case APEX_SIM_STOP_REQUESTED:
+            return "stop_requested";
+
+        case BATCH_LOAD_ERROR:
+            return "load_error";
+
+        case BATCH_CONFIG_ERROR:
+            return "config_error";
+    }
+
+    return "unknown";
+}
+
+/*
+ * Reads the manifest into a job array. Returns the number of jobs, or -1 if
+ * the manifest cannot be read.
+ */
+static int
+batch_read_manifest(const char *manifest, Batch_Job **jobs_out)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t len = 0;
+    int line_no = 0;
+    int num_jobs = 0;
+    int capacity = 64;
+    Batch_Job *jobs;
+
+    fp = fopen(manifest, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open manifest %s\n", manifest);
+        return -1;
+    }
+
+    jobs = malloc(capacity * sizeof(Batch_Job));
+    if (!jobs)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    while (getline(&line, &len, fp) != -1)
+    {
+        Batch_Job job;
+        char *p = line;
+        int fields;
+
+        line_no++;
+
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+
+        if (*p == '\0' || *p == '\n' || *p == '#')
+        {
+            continue;
+        }
+
+        memset(&job, 0, sizeof(job));
+        strcpy(job.config, "-");
+        fields = sscanf(p, "%1023s %d %1023s", job.program, &job.cycles, job.config);
+        if (fields < 2)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: expected <program> <cycles> [<config>]\n",
+                    manifest, line_no);
+            free(line);
+            free(jobs);
+            fclose(fp);
+            return -1;
+        }
+
+        /* A job that never halts would hold its worker forever, so every
+         * job needs a cycle budget */
+        if (job.cycles < 1)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: <cycles> must be at least 1 in a batch\n",
+                    manifest, line_no);
+            free(line);
+            free(jobs);
+            fclose(fp);
+            return -1;
+        }
+
+        if (num_jobs == capacity)
+        {
+            Batch_Job *grown;
+
+            capacity *= 2;
+            grown = realloc(jobs, capacity * sizeof(Batch_Job));
+            if (!grown)
+            {
+                free(line);
+                free(jobs);
+                fclose(fp);
+                return -1;
+            }
+            jobs = grown;
+        }
+
+        jobs[num_jobs++] = job;
+    }
+
+    free(line);
+    fclose(fp);
+    *jobs_out = jobs;
+    return num_jobs;
+}
+
+/*
+ * Parses every distinct program named in the manifest exactly once and points
+ * each job at its shared code memory.
+ */
+static int
+batch_load_programs(Batch_Context *ctx)
+{
+    int i, j;
+
+    ctx->programs = calloc(ctx->num_jobs + 1, sizeof(Batch_Program));
+    if (!ctx->programs)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < ctx->num_jobs; ++i)
+    {
+        Batch_Job *job = &ctx->jobs[i];
+
+        for (j = 0; j < ctx->num_programs; ++j)
+        {
+            if (strcmp(ctx->programs[j].path, job->program) == 0)
+            {
+                break;
+            }
+        }
+
+        if (j == ctx->num_programs)
+        {
+            Batch_Program *prog = &ctx->programs[ctx->num_programs++];
+
+            prog->path = job->program;
+            prog->code_memory = create_code_memory(job->program, &prog->code_memory_size);
+            if (!prog->code_memory)
+            {
+                fprintf(stderr, "APEX_Error: Unable to load program %s\n", job->program);
+            }
+        }
+
+        job->program_index = j;
+    }
+
+    return TRUE;
+}
+
+/* Resolves the <config> column of a job on top of the base configuration */
+static int
+batch_job_config(const Batch_Job *job, const APEX_Config *base, APEX_Config *config)
+{
+    char settings[MAX_BATCH_PATH];
+    char *setting, *save_ptr;
+
+    *config = *base;
+
+    if (strcmp(job->config, "-") == 0)
+    {
+        return TRUE;
+    }
+
+    if (!strchr(job->config, '='))
+    {
+        return APEX_config_load(config, job->config);
+    }
+
+    strcpy(settings, job->config);
+    for (setting = strtok_r(settings, ",", &save_ptr); setting;
+         setting = strtok_r(NULL, ",", &save_ptr))
+    {
+        if (!APEX_config_set(config, setting))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+batch_run_job(Batch_Context *ctx, Batch_Job *job)
+{
+    Batch_Program *prog = &ctx->programs[job->program_index];
+    APEX_Config config;
+    APEX_CPU *cpu;
+
+    if (!batch_job_config(job, ctx->config, &config))
+    {
+        job->status = BATCH_CONFIG_ERROR;
+        return;
+    }
+
+    cpu = APEX_cpu_create(prog->code_memory, prog->code_memory_size, 0);
+    if (!cpu)
+    {
+        job->status = BATCH_LOAD_ERROR;
+        return;
+    }
+
+    if (!APEX_cpu_configure(cpu, &config))
+    {
+        APEX_cpu_stop(cpu);
+        job->status = BATCH_CONFIG_ERROR;
+        return;
+    }
+    cpu->single_step = 0;
+    job->status = APEX_cpu_loop(cpu, job->cycles);
+    job->clock = cpu->clock;
+    job->insn_completed = cpu->insn_completed;
+    APEX_cpu_stop(cpu);
+}
+
+/* Takes the most recently queued job of the worker's own deque */
+static int
+batch_pop(Batch_Deque *dq)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top)
+    {
+        job = dq->jobs[--dq->bottom];
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    return job;
+}
+
+/* Takes the oldest queued job of another worker's deque */
+static int
+batch_steal(Batch_Deque *dq)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom > dq->top)
+    {
+        job = dq->jobs[dq->top++];
+    }
+    pthread_mutex_unlock(&dq->lock);
+
+    return job;
+}
+
+static void *
+batch_worker_main(void *arg)
+{
+    Batch_Worker *worker = arg;
+    Batch_Context *ctx = worker->ctx;
+    int i, job;
+
+    while (TRUE)
+    {
+        job = batch_pop(&ctx->deques[worker->id]);
+
+        /* No jobs are added once the pool starts, so an empty round of
+         * stealing means all work has been handed out */
+        for (i = 1; job < 0 && i < ctx->num_workers; ++i)
+        {
+            job = batch_steal(&ctx->deques[(worker->id + i) % ctx->num_workers]);
+            if (job >= 0)
+            {
+                worker->jobs_stolen++;
+            }
+        }
+
+        if (job < 0)
+        {
+            break;
+        }
+
+        batch_run_job(ctx, &ctx->jobs[job]);
+        worker->jobs_run++;
+    }
+
+    return NULL;
+}
+
+static void
+batch_print_results(const Batch_Context *ctx)
+{
+    int i;
+
+    printf("program,cycle_budget,config,status,cycles,instructions,cpi\n");
+
+    for (i = 0; i < ctx->num_jobs; ++i)
+    {
+        const Batch_Job *job = &ctx->jobs[i];
+        double cpi = job->insn_completed ? (double)job->clock / job->insn_completed : 0.0;
+
+        /* Override lists contain commas, so the config column is quoted */
+        printf("%s,%d,\"%s\",%s,%d,%d,%.4f\n", job->program, job->cycles, job->config,
+               batch_status_str(job->status), job->clock, job->insn_completed, cpi);
+    }
+}
+
+/*
+ * Runs every job in the manifest on num_threads workers (0 uses one worker
+ * per online core), on top of the given configuration, and prints the
+ * results.
+ *
+ * Returns 0 on success, 1 if the manifest could not be processed.
+ */
+int
+APEX_batch_run(const char *manifest, int num_threads, const APEX_Config *config)
+{
+    Batch_Context ctx;
+    struct timespec start, end;
+    int i, stolen = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.config = config;
+
+    ctx.num_jobs = batch_read_manifest(manifest, &ctx.jobs);
+    if (ctx.num_jobs < 0)
+    {
+        return 1;
+    }
+
+    if (num_threads <= 0)
+    {
+        num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (num_threads < 1)
+    {
+        num_threads = 1;
+    }
+    if (num_threads > MAX_BATCH_THREADS)
+    {
+        num_threads = MAX_BATCH_THREADS;
+    }
+    ctx.num_workers = num_threads;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!batch_load_programs(&ctx))
+    {
+        free(ctx.jobs);
+        return 1;
+    }
+
+    ctx.deques = calloc(ctx.num_workers, sizeof(Batch_Deque));
+    ctx.workers = calloc(ctx.num_workers, sizeof(Batch_Worker));
+    for (i = 0; ctx.deques && i < ctx.num_workers; ++i)
+    {
+        ctx.deques[i].jobs = malloc((ctx.num_jobs / ctx.num_workers + 1) * sizeof(int));
+        if (!ctx.deques[i].jobs)
+        {
+            break;
+        }
+    }
+    if (!ctx.deques || !ctx.workers || i < ctx.num_workers)
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate %d batch workers\n", ctx.num_workers);
+        for (i = 0; ctx.deques && i < ctx.num_workers; ++i)
+        {
+            free(ctx.deques[i].jobs);
+        }
+        for (i = 0; i < ctx.num_programs; ++i)
+        {
+            free(ctx.programs[i].code_memory);
+        }
+        free(ctx.deques);
+        free(ctx.workers);
+        free(ctx.programs);
+        free(ctx.jobs);
+        return 1;
+    }
+
+    /* Deal the jobs out round-robin; imbalance is fixed up by stealing */
+    for (i = 0; i < ctx.num_workers; ++i)
+    {
+        pthread_mutex_init(&ctx.deques[i].lock, NULL);
+    }
+    for (i = 0; i < ctx.num_jobs; ++i)
+    {
+        Batch_Deque *dq = &ctx.deques[i % ctx.num_workers];
+
+        dq->jobs[dq->bottom++] = i;
+    }
+
+    for (i = 0; i < ctx.num_workers; ++i)
+    {
+        ctx.workers[i].id = i;
+        ctx.workers[i].ctx = &ctx;
+        pthread_create(&ctx.workers[i].thread, NULL, batch_worker_main, &ctx.workers[i]);
+    }
+
+    for (i = 0; i < ctx.num_workers; ++i)
+    {
+        pthread_join(ctx.workers[i].thread, NULL);
+        stolen += ctx.workers[i].jobs_stolen;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    batch_print_results(&ctx);
+    fprintf(stderr, "APEX_BATCH: %d jobs, %d programs, %d threads, %d stolen, %.3f s\n",
+            ctx.num_jobs, ctx.num_programs, ctx.num_workers, stolen,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    for (i = 0; i < ctx.num_workers; ++i)
+    {
+        pthread_mutex_destroy(&ctx.deques[i].lock);
+        free(ctx.deques[i].jobs);
+    }
+    for (i = 0; i < ctx.num_programs; ++i)
+    {
+        free(ctx.programs[i].code_memory);
+    }
+    free(ctx.deques);
+    free(ctx.workers);
+    free(ctx.programs);
+    free(ctx.jobs);
+    return 0;
+}
@@ -0,0 +1,386 @@
+/*
+ * apex_bpred.c
+ * Branch prediction: direction predictors and the branch target buffer
+ *
+ * Fetch asks the predictor about every BZ/BNZ it fetches. A branch predicted
+ * taken whose target is in the BTB redirects fetch to the target; anything
+ * else falls through to pc + 4. The integer FU resolves the branch, updates
+ * the predictor and, on a misprediction, flushes the younger instructions
+ * and restarts fetch on the right path.
+ *
+ * A direction predictor is a row of bpred_table: predict returns the
+ * direction and a context (the table index it used), which travels with the
+ * branch down the pipeline and is handed back to update when it resolves.
+ * Global history is updated at resolution, so it only holds resolved
+ * branches.
+ *
+ * The BTB is tagged with the full branch pc. APEX branches are pc relative,
+ * so a BTB hit always has the right target.
+ *
+ * APEX_bpred_sweep compares predictors in a single run: shadow predictors,
+ * sized like the pipeline's own, predict and learn every branch the
+ * integer FU resolves without steering fetch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* 2-bit saturating counters: 0, 1 predict not taken, 2, 3 taken */
+#define COUNTER_WEAKLY_NOT_TAKEN 1
+#define COUNTER_MAX 3
+
+typedef struct BPred_Kind
+{
+    int (*predict)(const APEX_BPred *bp, int pc, int target, int *ctx);
+    void (*update)(APEX_BPred *bp, int pc, int ctx, int taken);
+} BPred_Kind;
+
+static int
+counter_taken(unsigned char counter)
+{
+    return counter > COUNTER_WEAKLY_NOT_TAKEN;
+}
+
+static void
+counter_update(unsigned char *counter, int taken)
+{
+    if (taken && *counter < COUNTER_MAX)
+    {
+        (*counter)++;
+    }
+    else if (!taken && *counter > 0)
+    {
+        (*counter)--;
+    }
+}
+
+static int
+pc_index(const APEX_BPred *bp, int pc)
+{
+    return (pc >> 2) & bp->table_mask;
+}
+
+static int
+gshare_index(const APEX_BPred *bp, int pc)
+{
+    return ((pc >> 2) ^ bp->history) & bp->table_mask;
+}
+
+/* Static: never taken, which is what fetch did before there was a predictor */
+static int
+not_taken_predict(const APEX_BPred *bp, int pc, int target, int *ctx)
+{
+    return FALSE;
+}
+
+/* Static: taken if the branch goes backward, as loop branches do */
+static int
+backward_taken_predict(const APEX_BPred *bp, int pc, int target, int *ctx)
+{
+    return target < pc;
+}
+
+static void
+static_update(APEX_BPred *bp, int pc, int ctx, int taken)
+{
+}
+
+/* A 2-bit counter per branch, indexed by pc */
+static int
+bimodal_predict(const APEX_BPred *bp, int pc, int target, int *ctx)
+{
+    *ctx = pc_index(bp, pc);
+    return counter_taken(bp->bimodal[*ctx]);
+}
+
+static void
+bimodal_update(APEX_BPred *bp, int pc, int ctx, int taken)
+{
+    counter_update(&bp->bimodal[ctx], taken);
+}
+
+/* A 2-bit counter per pc and global history pattern, indexed by their xor */
+static int
+gshare_predict(const APEX_BPred *bp, int pc, int target, int *ctx)
+{
+    *ctx = gshare_index(bp, pc);
+    return counter_taken(bp->gshare[*ctx]);
+}
+
+static void
+gshare_update(APEX_BPred *bp, int pc, int ctx, int taken)
+{
+    counter_update(&bp->gshare[ctx], taken);
+}
+
+/* Bimodal and gshare side by side; a per pc 2-bit chooser picks the one
+ * that has been right more often */
+static int
+tournament_predict(const APEX_BPred *bp, int pc, int target, int *ctx)
+{
+    int index = pc_index(bp, pc);
+
+    *ctx = gshare_index(bp, pc);
+    if (bp->chooser[index] > COUNTER_WEAKLY_NOT_TAKEN)
+    {
+        return counter_taken(bp->gshare[*ctx]);
+    }
+
+    return counter_taken(bp->bimodal[index]);
+}
+
+static void
+tournament_update(APEX_BPred *bp, int pc, int ctx, int taken)
+{
+    int index = pc_index(bp, pc);
+    int bimodal_right = counter_taken(bp->bimodal[index]) == taken;
+    int gshare_right = counter_taken(bp->gshare[ctx]) == taken;
+
+    if (bimodal_right != gshare_right)
+    {
+        counter_update(&bp->chooser[index], gshare_right);
+    }
+
+    counter_update(&bp->bimodal[index], taken);
+    counter_update(&bp->gshare[ctx], taken);
+}
+
+static const BPred_Kind bpred_table[NUM_BPREDS] = {
+    [BPRED_NOT_TAKEN]      = {not_taken_predict,      static_update},
+    [BPRED_BACKWARD_TAKEN] = {backward_taken_predict, static_update},
+    [BPRED_BIMODAL]        = {bimodal_predict,        bimodal_update},
+    [BPRED_GSHARE]         = {gshare_predict,         gshare_update},
+    [BPRED_TOURNAMENT]     = {tournament_predict,     tournament_update},
+};
+
+/* Values of the bpred setting, by BPRED_ number */
+const char *const APEX_bpred_names[NUM_BPREDS + 1] = {
+    [BPRED_NOT_TAKEN] = "not_taken",
+    [BPRED_BACKWARD_TAKEN] = "backward_taken",
+    [BPRED_BIMODAL] = "bimodal",
+    [BPRED_GSHARE] = "gshare",
+    [BPRED_TOURNAMENT] = "tournament",
+};
+
+/* Empties the tables and the BTB and sizes them from the configuration */
+void
+APEX_bpred_init(APEX_BPred *bp, const APEX_Config *config)
+{
+    int i;
+
+    bp->kind = config->bpred;
+    bp->table_mask = (1 << config->bpred_table_bits) - 1;
+    bp->history_mask = (1 << config->bpred_history_bits) - 1;
+    bp->history = 0;
+    memset(bp->bimodal, COUNTER_WEAKLY_NOT_TAKEN, sizeof(bp->bimodal));
+    memset(bp->gshare, COUNTER_WEAKLY_NOT_TAKEN, sizeof(bp->gshare));
+    memset(bp->chooser, COUNTER_WEAKLY_NOT_TAKEN, sizeof(bp->chooser));
+
+    bp->btb_mask = (1 << config->btb_bits) - 1;
+    for (i = 0; i <= bp->btb_mask; ++i)
+    {
+        bp->btb[i].pc = -1;
+    }
+
+    APEX_bpred_reset_stats(bp);
+}
+
+void
+APEX_bpred_reset_stats(APEX_BPred *bp)
+{
+    bp->branches = 0;
+    bp->mispredicts = 0;
+    bp->squashed = 0;
+    bp->lost_cycles = 0;
+    bp->recovering = FALSE;
+}
+
+/*
+ * Predicts the branch at pc. Returns TRUE, with its target in *target, if
+ * fetch should continue at the target: the direction predictor says taken
+ * and the BTB knows the target. *ctx is to be passed to APEX_bpred_update.
+ */
+int
+APEX_bpred_predict(const APEX_BPred *bp, int pc, int *target, int *ctx)
+{
+    const APEX_BTB_Entry *entry = &bp->btb[(pc >> 2) & bp->btb_mask];
+    int taken;
+
+    /* The direction predictor runs even on a BTB miss, so that it is trained
+     * with the context it had at fetch */
+    *ctx = 0;
+    *target = (entry->pc == pc) ? entry->target : pc + 4;
+    taken = bpred_table[bp->kind].predict(bp, pc, *target, ctx);
+
+    return taken && entry->pc == pc;
+}
+
+/* Trains the predictor with the outcome of the branch at pc */
+void
+APEX_bpred_update(APEX_BPred *bp, int pc, int ctx, int taken, int target)
+{
+    bpred_table[bp->kind].update(bp, pc, ctx, taken);
+    bp->history = ((bp->history << 1) | (taken ? 1 : 0)) & bp->history_mask;
+
+    if (taken)
+    {
+        bp->btb[(pc >> 2) & bp->btb_mask].pc = pc;
+        bp->btb[(pc >> 2) & bp->btb_mask].target = target;
+    }
+}
+
+/*
+ * Prints branches, direction mispredictions, accuracy, mispredictions per
+ * thousand instructions, the wrong path instructions flushed and the cycles
+ * lost to mispredictions: from each redirect until the first right path
+ * instruction issues (or, in the out-of-order core, is renamed).
+ */
+void
+APEX_bpred_print_stats(const APEX_BPred *bp, int instructions)
+{
+    double accuracy = bp->branches ? 100.0 * (bp->branches - bp->mispredicts) / bp->branches
+                                   : 0.0;
+    double mpki = instructions ? 1000.0 * bp->mispredicts / instructions : 0.0;
+
+    printf("================BRANCH PREDICTION==================\n");
+    printf("Predictor                   : %s\n", APEX_bpred_names[bp->kind]);
+    printf("Branches                    : %12lld\n", bp->branches);
+    printf("Mispredictions              : %12lld\n", bp->mispredicts);
+    printf("Accuracy                    : %11.2f%%\n", accuracy);
+    printf("MPKI                        : %12.4f\n", mpki);
+    printf("Instructions squashed       : %12lld\n", bp->squashed);
+    printf("Cycles lost to mispredicts  : %12lld\n", bp->lost_cycles);
+}
+
+/* Shadow predictors of a sweep, fed by the branch observer */
+typedef struct BPred_Sweep
+{
+    int num_preds;
+    APEX_BPred preds[NUM_BPREDS];
+} BPred_Sweep;
+
+static void
+sweep_branch(APEX_CPU *cpu, const CPU_Stage *stage, int taken, void *ctx)
+{
+    BPred_Sweep *sweep = ctx;
+    int target = stage->pc + stage->insn->imm;
+    int i, predicted_target, bpred_ctx;
+
+    for (i = 0; i < sweep->num_preds; ++i)
+    {
+        APEX_BPred *bp = &sweep->preds[i];
+
+        bp->branches++;
+        if (APEX_bpred_predict(bp, stage->pc, &predicted_target, &bpred_ctx) != taken)
+        {
+            bp->mispredicts++;
+        }
+        APEX_bpred_update(bp, stage->pc, bpred_ctx, taken, target);
+    }
+}
+
+/* Adds a shadow predictor per name of the comma separated list */
+static int
+sweep_add_predictors(BPred_Sweep *sweep, const APEX_Config *config, const char *names)
+{
+    APEX_Config shadow = *config;
+    char list[MAX_BATCH_PATH];
+    char *name, *save_ptr;
+    int kind;
+
+    snprintf(list, sizeof(list), "%s", names);
+    for (name = strtok_r(list, ",", &save_ptr); name; name = strtok_r(NULL, ",", &save_ptr))
+    {
+        for (kind = 0; kind < NUM_BPREDS; ++kind)
+        {
+            if (strcmp(name, APEX_bpred_names[kind]) == 0)
+            {
+                break;
+            }
+        }
+
+        if (kind == NUM_BPREDS || sweep->num_preds == NUM_BPREDS)
+        {
+            fprintf(stderr, "APEX_Error: '%s' is not a predictor, or more than %d were given\n",
+                    name, NUM_BPREDS);
+            return FALSE;
+        }
+
+        shadow.bpred = kind;
+        APEX_bpred_init(&sweep->preds[sweep->num_preds++], &shadow);
+    }
+
+    return TRUE;
+}
+
+static void
+sweep_print_row(const char *name, const char *note, const APEX_BPred *bp, int instructions)
+{
+    printf("%-15s %-10s %12lld %14lld %9.2f%% %10.4f\n", name, note, bp->branches,
+           bp->mispredicts,
+           bp->branches ? 100.0 * (bp->branches - bp->mispredicts) / bp->branches : 0.0,
+           instructions ? 1000.0 * bp->mispredicts / instructions : 0.0);
+}
+
+/*
+ * Simulates like Simulate while every predictor in names, a comma separated
+ * list (all of them if NULL), predicts the same branch stream, and prints
+ * their accuracy side by side with the pipeline's own predictor.
+ *
+ * Shadows predict when a branch resolves, with the history of all older
+ * branches, so their accuracy can differ slightly from the pipeline's own
+ * predictor of the same kind, which predicts at fetch.
+ *
+ * Returns FALSE, after reporting why, if names holds an unknown predictor.
+ */
+int
+APEX_bpred_sweep(APEX_CPU *cpu, int totalCycles, const char *names)
+{
+    APEX_Observer observer;
+    BPred_Sweep *sweep;
+    int status, i;
+
+    sweep = calloc(1, sizeof(BPred_Sweep));
+    if (!sweep)
+    {
+        return FALSE;
+    }
+
+    if (!names)
+    {
+        names = "not_taken,backward_taken,bimodal,gshare,tournament";
+    }
+
+    if (!sweep_add_predictors(sweep, &cpu->config, names))
+    {
+        free(sweep);
+        return FALSE;
+    }
+
+    memset(&observer, 0, sizeof(observer));
+    observer.branch = sweep_branch;
+    observer.ctx = sweep;
+
+    APEX_cpu_add_observer(cpu, &observer);
+    status = APEX_cpu_loop(cpu, totalCycles);
+    APEX_cpu_remove_observer(cpu, &observer);
+
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+           status == APEX_SIM_HALTED ? "Complete" : "Stopped", cpu->clock, cpu->insn_completed);
+    printf("================PREDICTOR COMPARISON==================\n");
+    printf("%-15s %-10s %12s %14s %10s %10s\n", "Predictor", "", "Branches", "Mispredictions",
+           "Accuracy", "MPKI");
+    sweep_print_row(APEX_bpred_names[cpu->bpred.kind], "(pipeline)", &cpu->bpred,
+                    cpu->insn_completed);
+    for (i = 0; i < sweep->num_preds; ++i)
+    {
+        sweep_print_row(APEX_bpred_names[sweep->preds[i].kind], "", &sweep->preds[i],
+                        cpu->insn_completed);
+    }
+
+    free(sweep);
+    return TRUE;
+}
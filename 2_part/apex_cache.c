@@ -0,0 +1,575 @@
+/*
+ * apex_cache.c
+ * Set associative cache timing model
+ *
+ * A cache of size words holds size / line_size lines in sets of assoc
+ * ways; the set of an address is picked by the line address modulo the
+ * number of sets. Only the tags are modelled: the load/store FU still reads
+ * and writes data memory directly, and an access returns the cycles it
+ * takes, hit_latency on a hit plus miss_latency when the line has to be
+ * fetched.
+ *
+ * Write-back caches allocate a line on a store miss and mark it dirty; a
+ * dirty line is written back when it is evicted. Write-through caches send
+ * every store to memory, through a write buffer that hides its latency, and
+ * do not allocate on a store miss.
+ *
+ * APEX_cache_prefetch fills a line ahead of its first access, see
+ * apex_prefetch.c. The line records when its fill completes: an access
+ * that finds it still in flight waits for the rest of the fill, and
+ * prefetched lines evicted before any access count as unused.
+ *
+ * APEX_cache_sweep measures many caches in a single run instead. It keeps
+ * the lines the load/store FUs touch on one LRU stack (Mattson et al.): an
+ * access to the line d entries from the top hits in every fully associative
+ * LRU cache of more than d lines. Counting, on the way down, the entries
+ * that share the line's set for each power of two number of sets gives the
+ * distance within the set, and so hits of every set associative LRU cache
+ * of that many sets, all from the same walk (Hill and Smith's
+ * all-associativity simulation).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Lines the stack distance sweep keeps; older lines count as misses */
+#define SWEEP_STACK_LINES 4096
+
+/* log2 of the most sets a swept cache has: MAX_CACHE_LINES direct mapped */
+#define SWEEP_SET_BITS 10
+
+const char *const APEX_cache_replacement_names[NUM_CACHE_POLICIES + 1] = {
+    [CACHE_LRU] = "lru", [CACHE_PLRU] = "plru", [CACHE_RANDOM] = "random", NULL,
+};
+
+const char *const APEX_cache_write_names[NUM_CACHE_WRITE_POLICIES + 1] = {
+    [CACHE_WRITE_BACK] = "write_back", [CACHE_WRITE_THROUGH] = "write_through", NULL,
+};
+
+static int
+is_power_of_two(int value)
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+static int
+log2_of(int value)
+{
+    int bits = 0;
+
+    while ((1 << bits) < value)
+    {
+        bits++;
+    }
+    return bits;
+}
+
+/*
+ * Checks that the geometry of an enabled cache can be built: power of two
+ * line size and number of sets, at most MAX_CACHE_LINES lines, and a power
+ * of two associativity for PLRU. Returns FALSE, after reporting which, with
+ * name (the key prefix) in the message.
+ */
+int
+APEX_cache_config_check(const APEX_Cache_Config *config, const char *name)
+{
+    int lines;
+
+    if (!config->enabled)
+    {
+        return TRUE;
+    }
+
+    if (!is_power_of_two(config->line_size))
+    {
+        fprintf(stderr, "APEX_Error: %s_line_size must be a power of two\n", name);
+        return FALSE;
+    }
+
+    lines = config->size / config->line_size;
+    if (config->size % (config->line_size * config->assoc) != 0 ||
+        !is_power_of_two(lines / config->assoc))
+    {
+        fprintf(stderr, "APEX_Error: %s_size must be a power of two number of sets of "
+                "%s_assoc lines of %s_line_size words\n", name, name, name);
+        return FALSE;
+    }
+
+    if (lines > MAX_CACHE_LINES)
+    {
+        fprintf(stderr, "APEX_Error: %s_size / %s_line_size must be at most %d lines\n", name,
+                name, MAX_CACHE_LINES);
+        return FALSE;
+    }
+
+    if (config->replacement == CACHE_PLRU && !is_power_of_two(config->assoc))
+    {
+        fprintf(stderr, "APEX_Error: plru replacement needs a power of two %s_assoc\n", name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Sets up an empty cache; config must have passed APEX_cache_config_check */
+void
+APEX_cache_init(APEX_Cache *cache, const APEX_Cache_Config *config)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->config = *config;
+    if (!config->enabled)
+    {
+        return;
+    }
+
+    cache->line_bits = log2_of(config->line_size);
+    cache->set_mask = config->size / config->line_size / config->assoc - 1;
+    cache->random = 0x2545f491;
+}
+
+void
+APEX_cache_reset_stats(APEX_Cache *cache)
+{
+    cache->reads = 0;
+    cache->read_misses = 0;
+    cache->writes = 0;
+    cache->write_misses = 0;
+    cache->writebacks = 0;
+    cache->memory_writes = 0;
+    cache->prefetches = 0;
+    cache->prefetch_hits = 0;
+    cache->prefetch_late = 0;
+    cache->prefetch_late_cycles = 0;
+    cache->prefetch_unused = 0;
+}
+
+/*
+ * PLRU keeps a binary tree over the ways of a set: node n (1 .. assoc - 1)
+ * has children 2n and 2n + 1, the leaves assoc .. 2 assoc - 1 are the ways,
+ * and the bit of a node points at the half to evict from next.
+ */
+static void
+plru_touch(APEX_Cache *cache, int set, int way)
+{
+    int node = way + cache->config.assoc;
+
+    while (node > 1)
+    {
+        int parent = node >> 1;
+
+        /* Point away from the half just used */
+        if (node & 1)
+        {
+            cache->plru[set] &= ~(1u << parent);
+        }
+        else
+        {
+            cache->plru[set] |= 1u << parent;
+        }
+        node = parent;
+    }
+}
+
+static int
+plru_victim(const APEX_Cache *cache, int set)
+{
+    int node = 1;
+
+    while (node < cache->config.assoc)
+    {
+        node = 2 * node + ((cache->plru[set] >> node) & 1);
+    }
+    return node - cache->config.assoc;
+}
+
+static void
+cache_touch(APEX_Cache *cache, int set, int way)
+{
+    switch (cache->config.replacement)
+    {
+        case CACHE_LRU:
+            cache->lines[set * cache->config.assoc + way].last_used = cache->stamp++;
+            break;
+
+        case CACHE_PLRU:
+            plru_touch(cache, set, way);
+            break;
+    }
+}
+
+/* Way to fill on a miss: an invalid one if there is any, else by policy */
+static int
+cache_victim(APEX_Cache *cache, int set)
+{
+    const APEX_Cache_Line *lines = &cache->lines[set * cache->config.assoc];
+    int way, victim;
+
+    for (way = 0; way < cache->config.assoc; ++way)
+    {
+        if (!lines[way].valid)
+        {
+            return way;
+        }
+    }
+
+    switch (cache->config.replacement)
+    {
+        case CACHE_LRU:
+            /* Oldest by age, which survives the stamp wrapping around */
+            victim = 0;
+            for (way = 1; way < cache->config.assoc; ++way)
+            {
+                if (cache->stamp - lines[way].last_used > cache->stamp - lines[victim].last_used)
+                {
+                    victim = way;
+                }
+            }
+            return victim;
+
+        case CACHE_PLRU:
+            return plru_victim(cache, set);
+
+        default:
+            cache->random ^= cache->random << 13;
+            cache->random ^= cache->random >> 17;
+            cache->random ^= cache->random << 5;
+            return cache->random % cache->config.assoc;
+    }
+}
+
+/* Way to fill on a miss, with the victim written back if it is dirty */
+static int
+cache_evict(APEX_Cache *cache, APEX_Memory *memory, int set, long long now)
+{
+    APEX_Cache_Line *line;
+    int way = cache_victim(cache, set);
+
+    line = &cache->lines[set * cache->config.assoc + way];
+    if (line->valid && line->dirty)
+    {
+        cache->writebacks++;
+        if (memory)
+        {
+            APEX_memory_access(memory, line->tag << cache->line_bits, TRUE, now);
+        }
+    }
+    if (line->valid && line->prefetched)
+    {
+        cache->prefetch_unused++;
+    }
+    return way;
+}
+
+/*
+ * Looks up the line holding address for a load (is_write FALSE) or a
+ * store issued at cycle now, updates replacement state and statistics, and
+ * returns the cycles the access takes.
+ *
+ * With memory NULL a line fill takes miss_latency. Otherwise memory times
+ * the fill, and also the writebacks and write-through stores, which go
+ * through a write buffer and do not add to the access.
+ */
+int
+APEX_cache_access(APEX_Cache *cache, APEX_Memory *memory, int address, int is_write,
+                  long long now)
+{
+    const APEX_Cache_Config *config = &cache->config;
+    unsigned int tag = (unsigned int)address >> cache->line_bits;
+    int set = tag & cache->set_mask;
+    APEX_Cache_Line *lines = &cache->lines[set * config->assoc];
+    int way, fill;
+
+    cache->trigger = TRUE;
+    if (is_write)
+    {
+        cache->writes++;
+        if (config->write_policy == CACHE_WRITE_THROUGH)
+        {
+            cache->memory_writes++;
+            if (memory)
+            {
+                APEX_memory_access(memory, address, TRUE, now);
+            }
+        }
+    }
+    else
+    {
+        cache->reads++;
+    }
+
+    for (way = 0; way < config->assoc; ++way)
+    {
+        if (lines[way].valid && lines[way].tag == tag)
+        {
+            if (is_write && config->write_policy == CACHE_WRITE_BACK)
+            {
+                lines[way].dirty = TRUE;
+            }
+            cache_touch(cache, set, way);
+            if (lines[way].prefetched)
+            {
+                lines[way].prefetched = FALSE;
+                cache->prefetch_hits++;
+                if (lines[way].ready > now)
+                {
+                    cache->prefetch_late++;
+                    cache->prefetch_late_cycles += lines[way].ready - now;
+                    return config->hit_latency + (int)(lines[way].ready - now);
+                }
+                return config->hit_latency;
+            }
+            cache->trigger = FALSE;
+            return config->hit_latency;
+        }
+    }
+
+    if (is_write)
+    {
+        cache->write_misses++;
+        if (config->write_policy == CACHE_WRITE_THROUGH)
+        {
+            return config->hit_latency;
+        }
+    }
+    else
+    {
+        cache->read_misses++;
+    }
+
+    /* The fill goes to memory ahead of the writeback of the victim */
+    fill = memory ? APEX_memory_access(memory, tag << cache->line_bits, FALSE, now)
+                  : config->miss_latency;
+
+    way = cache_evict(cache, memory, set, now);
+    lines[way].tag = tag;
+    lines[way].valid = TRUE;
+    lines[way].dirty = is_write;
+    lines[way].prefetched = FALSE;
+    cache_touch(cache, set, way);
+    return config->hit_latency + fill;
+}
+
+/*
+ * Starts filling the line holding address at cycle now, unless the cache
+ * already has it, without counting an access. Returns TRUE if it did. The
+ * line is inserted as most recently used.
+ */
+int
+APEX_cache_prefetch(APEX_Cache *cache, APEX_Memory *memory, int address, long long now)
+{
+    unsigned int tag = (unsigned int)address >> cache->line_bits;
+    int set = tag & cache->set_mask;
+    APEX_Cache_Line *lines = &cache->lines[set * cache->config.assoc];
+    int way, fill;
+
+    for (way = 0; way < cache->config.assoc; ++way)
+    {
+        if (lines[way].valid && lines[way].tag == tag)
+        {
+            return FALSE;
+        }
+    }
+
+    fill = memory ? APEX_memory_access(memory, tag << cache->line_bits, FALSE, now)
+                  : cache->config.miss_latency;
+
+    way = cache_evict(cache, memory, set, now);
+    lines[way].tag = tag;
+    lines[way].valid = TRUE;
+    lines[way].dirty = FALSE;
+    lines[way].prefetched = TRUE;
+    lines[way].ready = now + fill;
+    cache_touch(cache, set, way);
+    cache->prefetches++;
+    return TRUE;
+}
+
+void
+APEX_cache_print_stats(const APEX_Cache *cache, const char *title)
+{
+    const APEX_Cache_Config *config = &cache->config;
+    long long accesses = cache->reads + cache->writes;
+    long long misses = cache->read_misses + cache->write_misses;
+
+    printf("================%s==================\n", title);
+    if (!config->enabled)
+    {
+        printf("Cache                       : off\n");
+        return;
+    }
+
+    printf("Geometry                    : %d words, %d-way, %d word lines\n", config->size,
+           config->assoc, config->line_size);
+    printf("Replacement                 : %s\n",
+           APEX_cache_replacement_names[config->replacement]);
+    printf("Reads                       : %12lld (%lld misses)\n", cache->reads,
+           cache->read_misses);
+    printf("Hit rate                    : %11.2f%%\n",
+           accesses ? 100.0 * (accesses - misses) / accesses : 0.0);
+
+    /* Nothing to say about writes to a read-only (instruction) cache */
+    if (!cache->writes)
+    {
+        return;
+    }
+    printf("Write policy                : %s\n", APEX_cache_write_names[config->write_policy]);
+    printf("Writes                      : %12lld (%lld misses)\n", cache->writes,
+           cache->write_misses);
+    printf("Writebacks                  : %12lld\n", cache->writebacks);
+    printf("Write-through stores        : %12lld\n", cache->memory_writes);
+}
+
+/* Stack distance histograms of a sweep, fed by the memory observer */
+typedef struct Cache_Sweep
+{
+    int line_bits;
+    int depth;                     /* Lines on the stack */
+    unsigned int stack[SWEEP_STACK_LINES]; /* Line addresses, most recent first */
+    long long accesses;
+
+    /* Hits by stack distance, fully associative and, by log2 number of
+     * sets, within the set */
+    long long full_hits[MAX_CACHE_LINES];
+    long long set_hits[SWEEP_SET_BITS + 1][MAX_CACHE_ASSOC];
+} Cache_Sweep;
+
+static void
+sweep_memory(APEX_CPU *cpu, const CPU_Stage *stage, void *ctx)
+{
+    Cache_Sweep *sweep = ctx;
+    unsigned int line = (unsigned int)stage->memory_address >> sweep->line_bits;
+    int in_set[SWEEP_SET_BITS + 1] = {0};
+    int d, b;
+
+    sweep->accesses++;
+    for (d = 0; d < sweep->depth && sweep->stack[d] != line; ++d)
+    {
+        unsigned int diff = sweep->stack[d] ^ line;
+
+        /* Same set as line for 2^b sets while the low b bits agree */
+        for (b = 0; b <= SWEEP_SET_BITS; ++b)
+        {
+            in_set[b]++;
+            if ((diff >> b) & 1)
+            {
+                break;
+            }
+        }
+    }
+
+    if (d < sweep->depth)
+    {
+        if (d < MAX_CACHE_LINES)
+        {
+            sweep->full_hits[d]++;
+        }
+        for (b = 0; b <= SWEEP_SET_BITS; ++b)
+        {
+            if (in_set[b] < MAX_CACHE_ASSOC)
+            {
+                sweep->set_hits[b][in_set[b]]++;
+            }
+        }
+    }
+    else if (sweep->depth < SWEEP_STACK_LINES)
+    {
+        sweep->depth++;
+    }
+    else
+    {
+        d = SWEEP_STACK_LINES - 1;
+    }
+
+    memmove(&sweep->stack[1], &sweep->stack[0], d * sizeof(sweep->stack[0]));
+    sweep->stack[0] = line;
+}
+
+/* Miss ratio of an LRU cache of 2^set_bits sets of assoc ways, or fully
+ * associative with assoc lines if set_bits is -1 */
+static double
+sweep_miss_ratio(const Cache_Sweep *sweep, int set_bits, int assoc)
+{
+    long long hits = 0;
+    int d;
+
+    for (d = 0; d < assoc; ++d)
+    {
+        hits += set_bits < 0 ? sweep->full_hits[d] : sweep->set_hits[set_bits][d];
+    }
+    return sweep->accesses ? 100.0 * (sweep->accesses - hits) / sweep->accesses : 0.0;
+}
+
+/*
+ * Simulates like Simulate while the load/store address stream is run
+ * through the stack distance analyzer, and prints the miss ratio of LRU
+ * caches of every power of two size up to MAX_CACHE_LINES lines, direct
+ * mapped, 2 to 16-way and fully associative. Lines are dcache_line_size
+ * words; loads and stores count alike, as in a write-allocate cache.
+ *
+ * Returns FALSE, after reporting why, if dcache_line_size is not a power
+ * of two.
+ */
+int
+APEX_cache_sweep(APEX_CPU *cpu, int totalCycles)
+{
+    static const int sweep_assoc[] = {1, 2, 4, 8, MAX_CACHE_ASSOC};
+    const int num_assoc = sizeof(sweep_assoc) / sizeof(sweep_assoc[0]);
+    APEX_Observer observer;
+    Cache_Sweep *sweep;
+    int status, set_bits, lines, i;
+
+    if (!is_power_of_two(cpu->config.dcache.line_size))
+    {
+        fprintf(stderr, "APEX_Error: dcache_line_size must be a power of two\n");
+        return FALSE;
+    }
+
+    sweep = calloc(1, sizeof(Cache_Sweep));
+    if (!sweep)
+    {
+        return FALSE;
+    }
+    sweep->line_bits = log2_of(cpu->config.dcache.line_size);
+
+    memset(&observer, 0, sizeof(observer));
+    observer.memory = sweep_memory;
+    observer.ctx = sweep;
+
+    APEX_cpu_add_observer(cpu, &observer);
+    status = APEX_cpu_loop(cpu, totalCycles);
+    APEX_cpu_remove_observer(cpu, &observer);
+
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n",
+           status == APEX_SIM_HALTED ? "Complete" : "Stopped", cpu->clock, cpu->insn_completed);
+    printf("================CACHE MISS RATIOS==================\n");
+    printf("Accesses %lld, %d word lines, LRU\n", sweep->accesses,
+           cpu->config.dcache.line_size);
+    printf("%12s", "Size (words)");
+    for (i = 0; i < num_assoc; ++i)
+    {
+        printf(" %7d-way", sweep_assoc[i]);
+    }
+    printf(" %11s\n", "full");
+
+    for (lines = 1, set_bits = 0; lines <= MAX_CACHE_LINES; lines *= 2, set_bits++)
+    {
+        printf("%12d", lines * cpu->config.dcache.line_size);
+        for (i = 0; i < num_assoc; ++i)
+        {
+            if (sweep_assoc[i] > lines)
+            {
+                printf(" %11s", "-");
+                continue;
+            }
+            printf(" %10.2f%%", sweep_miss_ratio(sweep, log2_of(lines / sweep_assoc[i]),
+                                                 sweep_assoc[i]));
+        }
+        printf(" %10.2f%%\n", sweep_miss_ratio(sweep, -1, lines));
+    }
+
+    free(sweep);
+    return TRUE;
+}
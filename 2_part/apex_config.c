@@ -0,0 +1,402 @@
+/*
+ * apex_config.c
+ * Simulator configuration: functional units, operand forwarding, branch
+ * prediction, caches, prefetching, fetch, main memory, the load/store
+ * queue and the out-of-order core
+ *
+ * A configuration file has one setting per line,
+ *
+ *     <key> = <value>
+ *
+ * with blank lines and lines starting with '#' ignored. The same settings
+ * can be given one at a time as "<key>=<value>" overrides. Keys are listed
+ * in config_keys below; values are numbers, or names for keys with a list
+ * of names.
+ */
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+typedef struct Config_Key
+{
+    const char *name;
+    size_t offset;                 /* Offset of the int setting in APEX_Config */
+    int min;
+    int max;
+    const char *const *names;      /* NULL terminated names of min, min + 1, ... */
+} Config_Key;
+
+#define CONFIG_FIELD(field) offsetof(APEX_Config, field)
+
+static const Config_Key config_keys[] = {
+    {"int_fu_count",        CONFIG_FIELD(fu_count[FU_INT]),     1, MAX_FU_INSTANCES},
+    {"int_fu_latency",      CONFIG_FIELD(fu_latency[FU_INT]),   1, MAX_FU_LATENCY},
+    {"int_fu_pipelined",    CONFIG_FIELD(fu_pipelined[FU_INT]), 0, 1},
+    {"mul_fu_count",        CONFIG_FIELD(fu_count[FU_MUL]),     1, MAX_FU_INSTANCES},
+    {"mul_fu_latency",      CONFIG_FIELD(fu_latency[FU_MUL]),   1, MAX_FU_LATENCY},
+    {"mul_fu_pipelined",    CONFIG_FIELD(fu_pipelined[FU_MUL]), 0, 1},
+    {"ls_fu_count",         CONFIG_FIELD(fu_count[FU_LS]),      1, MAX_FU_INSTANCES},
+    {"ls_fu_latency",       CONFIG_FIELD(fu_latency[FU_LS]),    1, MAX_FU_LATENCY},
+    {"ls_fu_pipelined",     CONFIG_FIELD(fu_pipelined[FU_LS]),  0, 1},
+    {"forwarding",          CONFIG_FIELD(forwarding),           FORWARD_NONE, FORWARD_ALL},
+    {"bpred",               CONFIG_FIELD(bpred),                0, NUM_BPREDS - 1,
+     APEX_bpred_names},
+    {"bpred_table_bits",    CONFIG_FIELD(bpred_table_bits),     1, MAX_BPRED_TABLE_BITS},
+    {"bpred_history_bits",  CONFIG_FIELD(bpred_history_bits),   1, MAX_BPRED_TABLE_BITS},
+    {"btb_bits",            CONFIG_FIELD(btb_bits),             0, MAX_BTB_BITS},
+    {"dcache",              CONFIG_FIELD(dcache.enabled),       0, 1},
+    {"dcache_size",         CONFIG_FIELD(dcache.size),          1, MAX_CACHE_SIZE},
+    {"dcache_line_size",    CONFIG_FIELD(dcache.line_size),     1, MAX_CACHE_LINE_SIZE},
+    {"dcache_assoc",        CONFIG_FIELD(dcache.assoc),         1, MAX_CACHE_ASSOC},
+    {"dcache_replacement",  CONFIG_FIELD(dcache.replacement),   0, NUM_CACHE_POLICIES - 1,
+     APEX_cache_replacement_names},
+    {"dcache_write_policy", CONFIG_FIELD(dcache.write_policy),  0, NUM_CACHE_WRITE_POLICIES - 1,
+     APEX_cache_write_names},
+    {"dcache_hit_latency",  CONFIG_FIELD(dcache.hit_latency),   1, MAX_FU_LATENCY},
+    {"dcache_miss_latency", CONFIG_FIELD(dcache.miss_latency),  0, MAX_FU_LATENCY},
+    {"icache",              CONFIG_FIELD(icache.enabled),       0, 1},
+    {"icache_size",         CONFIG_FIELD(icache.size),          1, MAX_CACHE_SIZE},
+    {"icache_line_size",    CONFIG_FIELD(icache.line_size),     1, MAX_CACHE_LINE_SIZE},
+    {"icache_assoc",        CONFIG_FIELD(icache.assoc),         1, MAX_CACHE_ASSOC},
+    {"icache_replacement",  CONFIG_FIELD(icache.replacement),   0, NUM_CACHE_POLICIES - 1,
+     APEX_cache_replacement_names},
+    {"icache_hit_latency",  CONFIG_FIELD(icache.hit_latency),   1, MAX_FU_LATENCY},
+    {"icache_miss_latency", CONFIG_FIELD(icache.miss_latency),  0, MAX_FU_LATENCY},
+    {"fetch_width",         CONFIG_FIELD(fetch_width),          1, MAX_FETCH_WIDTH},
+    {"fetch_buffer",        CONFIG_FIELD(fetch_buffer),         0, MAX_FETCH_BUFFER},
+    {"memory",              CONFIG_FIELD(memory),               0, NUM_MEMORY_MODELS - 1,
+     APEX_memory_names},
+    {"dram_banks",          CONFIG_FIELD(dram_banks),           1, MAX_DRAM_BANKS},
+    {"dram_row_size",       CONFIG_FIELD(dram_row_size),        1, MAX_DRAM_ROW_SIZE},
+    {"dram_trcd",           CONFIG_FIELD(dram_trcd),            0, MAX_DRAM_TIMING},
+    {"dram_tcas",           CONFIG_FIELD(dram_tcas),            1, MAX_DRAM_TIMING},
+    {"dram_trp",            CONFIG_FIELD(dram_trp),             0, MAX_DRAM_TIMING},
+    {"dram_burst",          CONFIG_FIELD(dram_burst),           0, MAX_DRAM_TIMING},
+    {"dram_queue",          CONFIG_FIELD(dram_queue),           1, MAX_DRAM_QUEUE},
+    {"lsq_size",            CONFIG_FIELD(lsq_size),             0, MAX_FU_SLOTS},
+    {"lsq_forwarding",      CONFIG_FIELD(lsq_forwarding),       0, 1},
+    {"lsq_forward_latency", CONFIG_FIELD(lsq_forward_latency),  1, MAX_FU_LATENCY},
+    {"prefetch",            CONFIG_FIELD(prefetch),             0, NUM_PREFETCHERS - 1,
+     APEX_prefetch_names},
+    {"prefetch_table_bits", CONFIG_FIELD(prefetch_table_bits),  0, MAX_PREFETCH_TABLE_BITS},
+    {"prefetch_degree",     CONFIG_FIELD(prefetch_degree),      1, MAX_PREFETCH_DEGREE},
+    {"prefetch_distance",   CONFIG_FIELD(prefetch_distance),    1, MAX_PREFETCH_DISTANCE},
+    {"ooo",                 CONFIG_FIELD(ooo),                  0, 1},
+    {"rob_size",            CONFIG_FIELD(rob_size),             1, MAX_ROB_SIZE},
+    {"iq_size",             CONFIG_FIELD(iq_size),              1, MAX_IQ_SIZE},
+    {"phys_regs",           CONFIG_FIELD(phys_regs),            NUM_ARCH_REGS + 1, MAX_PHYS_REGS},
+    {"ooo_width",           CONFIG_FIELD(ooo_width),            1, MAX_OOO_WIDTH},
+    {"issue_width",         CONFIG_FIELD(issue_width),          1, MAX_ISSUE_WIDTH},
+};
+
+#define NUM_CONFIG_KEYS (int)(sizeof(config_keys) / sizeof(config_keys[0]))
+
+/* The configuration the simulator was written for */
+void
+APEX_config_default(APEX_Config *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->fu_count[FU_INT] = 1;
+    config->fu_count[FU_MUL] = 1;
+    config->fu_count[FU_LS] = 1;
+    config->fu_latency[FU_INT] = INT_FU_LATENCY;
+    config->fu_latency[FU_MUL] = MUL_FU_LATENCY;
+    config->fu_latency[FU_LS] = LS_FU_LATENCY;
+    config->bpred = BPRED_NOT_TAKEN;
+    config->bpred_table_bits = BPRED_TABLE_BITS;
+    config->bpred_history_bits = BPRED_HISTORY_BITS;
+    config->btb_bits = BTB_BITS;
+    config->dcache.size = DCACHE_SIZE;
+    config->dcache.line_size = DCACHE_LINE_SIZE;
+    config->dcache.assoc = DCACHE_ASSOC;
+    config->dcache.replacement = CACHE_LRU;
+    config->dcache.write_policy = CACHE_WRITE_BACK;
+    config->dcache.hit_latency = DCACHE_HIT_LATENCY;
+    config->dcache.miss_latency = DCACHE_MISS_LATENCY;
+    config->icache.size = ICACHE_SIZE;
+    config->icache.line_size = ICACHE_LINE_SIZE;
+    config->icache.assoc = ICACHE_ASSOC;
+    config->icache.replacement = CACHE_LRU;
+    config->icache.hit_latency = ICACHE_HIT_LATENCY;
+    config->icache.miss_latency = ICACHE_MISS_LATENCY;
+    config->fetch_width = 1;
+    config->memory = MEMORY_FLAT;
+    config->dram_banks = DRAM_BANKS;
+    config->dram_row_size = DRAM_ROW_SIZE;
+    config->dram_trcd = DRAM_TRCD;
+    config->dram_tcas = DRAM_TCAS;
+    config->dram_trp = DRAM_TRP;
+    config->dram_burst = DRAM_BURST;
+    config->dram_queue = DRAM_QUEUE;
+    config->lsq_forwarding = 1;
+    config->lsq_forward_latency = LSQ_FORWARD_LATENCY;
+    config->prefetch = PREFETCH_NONE;
+    config->prefetch_table_bits = PREFETCH_TABLE_BITS;
+    config->prefetch_degree = PREFETCH_DEGREE;
+    config->prefetch_distance = PREFETCH_DISTANCE;
+    config->rob_size = ROB_SIZE;
+    config->iq_size = IQ_SIZE;
+    config->phys_regs = PHYS_REGS;
+    config->ooo_width = 1;
+    config->issue_width = 1;
+}
+
+/* Key prefix of each FU class, as in config_keys */
+static const char *const config_fu_prefix[NUM_FU_CLASSES] = {
+    [FU_INT] = "int", [FU_MUL] = "mul", [FU_LS] = "ls",
+};
+
+/*
+ * Checks the limits that span several settings. Returns FALSE, after
+ * reporting which, if
+ *  - pipelined units of a class can hold more instructions than
+ *    MAX_FU_SLOTS,
+ *  - the global history does not fit the predictor table,
+ *  - the load/store queue is combined with several or pipelined load/store
+ *    FUs, or with the out-of-order core,
+ *  - a prefetcher is set without the data cache,
+ *  - the out-of-order core is given an issue_width above 1,
+ *  - fetch_width or issue_width exceeds what the fetch buffer can take, or
+ *    issue_width exceeds fetch_width,
+ *  - or a cache geometry cannot be built.
+ */
+int
+APEX_config_check(const APEX_Config *config)
+{
+    int fu;
+
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        if (config->fu_pipelined[fu] &&
+            config->fu_count[fu] * config->fu_latency[fu] > MAX_FU_SLOTS)
+        {
+            fprintf(stderr, "APEX_Error: pipelined %s FUs need %s_fu_count * %s_fu_latency "
+                    "<= %d\n", config_fu_prefix[fu], config_fu_prefix[fu],
+                    config_fu_prefix[fu], MAX_FU_SLOTS);
+            return FALSE;
+        }
+    }
+
+    if (config->bpred_history_bits > config->bpred_table_bits)
+    {
+        fprintf(stderr, "APEX_Error: bpred_history_bits must not exceed bpred_table_bits\n");
+        return FALSE;
+    }
+
+    if (config->lsq_size && (config->fu_count[FU_LS] > 1 || config->fu_pipelined[FU_LS]))
+    {
+        fprintf(stderr, "APEX_Error: the load/store queue replaces the load/store FUs; "
+                "leave ls_fu_count 1 and ls_fu_pipelined 0\n");
+        return FALSE;
+    }
+
+    if (config->ooo && config->lsq_size)
+    {
+        fprintf(stderr, "APEX_Error: the out-of-order core orders loads and stores in its "
+                "reorder buffer; leave lsq_size 0\n");
+        return FALSE;
+    }
+
+    if (config->prefetch != PREFETCH_NONE && !config->dcache.enabled)
+    {
+        fprintf(stderr, "APEX_Error: prefetch fills the data cache; set dcache=1\n");
+        return FALSE;
+    }
+
+    if (config->ooo && config->issue_width > 1)
+    {
+        fprintf(stderr, "APEX_Error: the out-of-order core issues ooo_width instructions; "
+                "leave issue_width 1\n");
+        return FALSE;
+    }
+
+    if (config->fetch_width > config->fetch_buffer + 1)
+    {
+        fprintf(stderr, "APEX_Error: fetch_width must not exceed fetch_buffer + 1\n");
+        return FALSE;
+    }
+
+    /* Decode takes the rest of an issue group from the fetch buffer, which
+     * fetch has to fill as fast */
+    if (config->issue_width > config->fetch_buffer + 1)
+    {
+        fprintf(stderr, "APEX_Error: issue_width must not exceed fetch_buffer + 1\n");
+        return FALSE;
+    }
+
+    if (config->issue_width > config->fetch_width)
+    {
+        fprintf(stderr, "APEX_Error: issue_width must not exceed fetch_width\n");
+        return FALSE;
+    }
+
+    return APEX_cache_config_check(&config->dcache, "dcache") &&
+           APEX_cache_config_check(&config->icache, "icache");
+}
+
+/*
+ * Value of the name at the start of text, blanks before it skipped, for a
+ * key with names. Sets *end past the name, or to text if there is none.
+ */
+static int
+config_name_value(const Config_Key *key, const char *text, char **end)
+{
+    const char *p = text;
+    int i, len;
+
+    while (*p == ' ' || *p == '\t')
+    {
+        p++;
+    }
+
+    for (i = 0; key->names[i]; ++i)
+    {
+        len = strlen(key->names[i]);
+        if (strncmp(p, key->names[i], len) == 0 &&
+            (p[len] == '\0' || p[len] == ' ' || p[len] == '\t' || p[len] == '\r' ||
+             p[len] == '\n'))
+        {
+            *end = (char *)p + len;
+            return key->min + i;
+        }
+    }
+
+    *end = (char *)text;
+    return 0;
+}
+
+/* Applies one setting; where prefixes error messages */
+static int
+config_apply(APEX_Config *config, const char *setting, const char *where)
+{
+    const char *eq = strchr(setting, '=');
+    const char *key = setting;
+    int key_len, value, i;
+    char *end;
+
+    if (!eq)
+    {
+        fprintf(stderr, "APEX_Error: %sconfig setting '%s' is not <key>=<value>\n", where,
+                setting);
+        return FALSE;
+    }
+
+    while (*key == ' ' || *key == '\t')
+    {
+        key++;
+    }
+    key_len = eq - key;
+    while (key_len > 0 && (key[key_len - 1] == ' ' || key[key_len - 1] == '\t'))
+    {
+        key_len--;
+    }
+
+    for (i = 0; i < NUM_CONFIG_KEYS; ++i)
+    {
+        if ((int)strlen(config_keys[i].name) == key_len &&
+            strncmp(config_keys[i].name, key, key_len) == 0)
+        {
+            break;
+        }
+    }
+
+    if (i == NUM_CONFIG_KEYS)
+    {
+        fprintf(stderr, "APEX_Error: %sunknown config key '%.*s'\n", where, key_len, key);
+        return FALSE;
+    }
+
+    value = strtol(eq + 1, &end, 10);
+    if (config_keys[i].names && end == eq + 1)
+    {
+        value = config_name_value(&config_keys[i], eq + 1, &end);
+    }
+    while (*end == ' ' || *end == '\t' || *end == '\r' || *end == '\n')
+    {
+        end++;
+    }
+
+    if (config_keys[i].names && (end == eq + 1 || *end != '\0'))
+    {
+        fprintf(stderr, "APEX_Error: %s%s must be one of", where, config_keys[i].name);
+        for (value = 0; config_keys[i].names[value]; ++value)
+        {
+            fprintf(stderr, " %s", config_keys[i].names[value]);
+        }
+        fprintf(stderr, "\n");
+        return FALSE;
+    }
+
+    if (end == eq + 1 || *end != '\0' || value < config_keys[i].min ||
+        value > config_keys[i].max)
+    {
+        fprintf(stderr, "APEX_Error: %s%s must be a number from %d to %d\n", where,
+                config_keys[i].name, config_keys[i].min, config_keys[i].max);
+        return FALSE;
+    }
+
+    *(int *)((char *)config + config_keys[i].offset) = value;
+    return TRUE;
+}
+
+/*
+ * Applies one "<key>=<value>" setting; blanks around key and value are
+ * allowed. Returns FALSE, after reporting why, if the key is unknown or the
+ * value is out of range.
+ */
+int
+APEX_config_set(APEX_Config *config, const char *setting)
+{
+    return config_apply(config, setting, "");
+}
+
+/*
+ * Applies every setting of a configuration file on top of config. Returns
+ * FALSE, after reporting file and line, if the file cannot be read or holds
+ * a bad setting.
+ */
+int
+APEX_config_load(APEX_Config *config, const char *filename)
+{
+    FILE *fp;
+    char where[MAX_BATCH_PATH + 16];
+    char *line = NULL;
+    size_t len = 0;
+    int line_no = 0;
+    int ok = TRUE;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open config %s\n", filename);
+        return FALSE;
+    }
+
+    while (ok && getline(&line, &len, fp) != -1)
+    {
+        char *p = line;
+
+        line_no++;
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+
+        if (*p == '\0' || *p == '\n' || *p == '\r' || *p == '#')
+        {
+            continue;
+        }
+
+        p[strcspn(p, "\r\n")] = '\0';
+        snprintf(where, sizeof(where), "%s:%d: ", filename, line_no);
+        ok = config_apply(config, p, where);
+    }
+
+    free(line);
+    fclose(fp);
+    return ok;
+}
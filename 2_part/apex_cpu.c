@@ -23,43 +23,44 @@ get_code_memory_index_from_pc(const int pc)
     return (pc - 4000) / 4;
 }
 
-int integerFUCounter;
-int mulFUCounter;
-int loadStoreFUCounter;
-
-int priorityQueue[MAX_QUEUE_SIZE];
-int rear = - 1;
-int front = 0;
-int itemCount = 0;
+/*
+ * Writeback arbitration queue: functional units enqueue their id when they
+ * start an instruction and may only hand over to writeback when they are at
+ * the head. The queue lives in the CPU so that instances stay independent.
+ */
+static void
+enqueue(APEX_CPU *cpu, int data)
+{
+    if (cpu->itemCount != MAX_QUEUE_SIZE)
+    {
+        if (cpu->rear == MAX_QUEUE_SIZE - 1)
+        {
+            cpu->rear = -1;
+        }
 
-void enqueue(int data) {
+        cpu->priorityQueue[++cpu->rear] = data;
+        cpu->itemCount++;
+    }
+}
 
-   if(itemCount !=  MAX_QUEUE_SIZE) {
-	
-      if(rear == MAX_QUEUE_SIZE-1) {
-         rear = -1;            
-      }       
+static int
+dequeue(APEX_CPU *cpu)
+{
+    int data = cpu->priorityQueue[cpu->front++];
 
-      priorityQueue[++rear] = data;
-      itemCount++;
-   }
-}
+    if (cpu->front == MAX_QUEUE_SIZE)
+    {
+        cpu->front = 0;
+    }
 
-int dequeue() {
-   int data = priorityQueue[front++];
-	
-   if(front == MAX_QUEUE_SIZE) {
-      front = 0;
-   }
-	
-   itemCount--;
-   return data;  
+    cpu->itemCount--;
+    return data;
 }
 
 static void
-print_instruction(const CPU_Stage *stage)
+print_instruction(const APEX_Instruction *ins)
 {
-    switch (stage->opcode)
+    switch (ins->opcode)
     {
         case OPCODE_ADD:
         case OPCODE_SUB:
@@ -70,62 +71,62 @@ print_instruction(const CPU_Stage *stage)
         case OPCODE_XOR:
         case OPCODE_LDR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d,R%d ", ins->info->mnemonic, ins->rd, ins->rs1, ins->rs2);
             break;
         }
 
         case OPCODE_MOVC:
         {
-            printf("%s,R%d,#%d ", stage->opcode_str, stage->rd, stage->imm);
+            printf("%s,R%d,#%d ", ins->info->mnemonic, ins->rd, ins->imm);
             break;
         }
 
         case OPCODE_LOAD:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            printf("%s,R%d,R%d,#%d ", ins->info->mnemonic, ins->rd, ins->rs1,
+                   ins->imm);
             break;
         }
 
         case OPCODE_STORE:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
-                   stage->imm);
+            printf("%s,R%d,R%d,#%d ", ins->info->mnemonic, ins->rs1, ins->rs2,
+                   ins->imm);
             break;
         }
 
         case OPCODE_BZ:
         case OPCODE_BNZ:
         {
-            printf("%s,#%d ", stage->opcode_str, stage->imm);
+            printf("%s,#%d ", ins->info->mnemonic, ins->imm);
             break;
         }
 
         case OPCODE_HALT:
         case OPCODE_NOP:
         {
-            printf("%s", stage->opcode_str);
+            printf("%s", ins->info->mnemonic);
             break;
         }
 
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
-                   stage->imm);
+            printf("%s,R%d,R%d,#%d ", ins->info->mnemonic, ins->rd, ins->rs1,
+                   ins->imm);
             break;
         }
 
         case OPCODE_CMP:
         {
-            printf("%s,R%d,R%d", stage->opcode_str, stage->rs1, stage->rs2);
+            printf("%s,R%d,R%d", ins->info->mnemonic, ins->rs1, ins->rs2);
             break;
         }
 
         case OPCODE_STR:
         {
-            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rs3, stage->rs1,
-                   stage->rs2);
+            printf("%s,R%d,R%d,R%d ", ins->info->mnemonic, ins->rs3, ins->rs1,
+                   ins->rs2);
             break;
         }
     }
@@ -139,7 +140,7 @@ static void
 print_stage_content(const char *name, const CPU_Stage *stage)
 {
     printf("%-15s: pc(%d) ", name, stage->pc);
-    print_instruction(stage);
+    print_instruction(stage->insn);
     printf("\n");
 }
 
@@ -180,1007 +181,2175 @@ print_reg_file(APEX_CPU *cpu)
 }
 
 /*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Observer notifications. Stage functions only call these when the cycle is
+ * being observed, so unobserved runs never touch the observer list.
  */
 static void
-APEX_fetch(APEX_CPU *cpu, int printMsg)
+notify_stage(APEX_CPU *cpu, const char *name, const CPU_Stage *stage, int has_insn)
 {
+    int i;
 
-   // storing data in memory location 70
-   // cpu->data_memory[70] = 24;
-    APEX_Instruction *current_ins;
-
-    if(cpu->is_waiting_decode == 1){
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.rs3 = current_ins->rs3;
-        cpu->fetch.imm = current_ins->imm;
-        if(printMsg == 1){
-          print_stage_content("Fetch", &cpu->fetch);
-        }        
-        return;
-    }
-
-    if (cpu->fetch.has_insn) 
+    for (i = 0; i < cpu->num_observers; ++i)
     {
-        //cpu->is_waiting_fetch = 1;
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
+        if (cpu->observers[i]->stage)
         {
-            cpu->fetch_from_next_cycle = FALSE;
-
-            /* Skip this cycle*/
-            return;
+            cpu->observers[i]->stage(cpu, name, stage, has_insn, cpu->observers[i]->ctx);
         }
+    }
+}
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
-
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.rs3 = current_ins->rs3;
-        cpu->fetch.imm = current_ins->imm;
-
-        /* Update PC for next instruction */
-        cpu->pc += 4;
+static void
+notify_retire(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int i;
 
-        /* Copy data from fetch latch to decode latch*/
-        if(cpu->is_waiting_decode == 0){
-            cpu->decode = cpu->fetch;
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i]->retire)
+        {
+            cpu->observers[i]->retire(cpu, stage, cpu->observers[i]->ctx);
         }
+    }
+}
+
+static void
+notify_stall(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int i;
 
-        if (printMsg == 1)
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i]->stall)
         {
-           print_stage_content("Fetch", &cpu->fetch);
+            cpu->observers[i]->stall(cpu, stage, cpu->observers[i]->ctx);
         }
-        
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
+    }
+}
+
+static void
+notify_branch(APEX_CPU *cpu, const CPU_Stage *stage, int taken)
+{
+    int i;
+
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i]->branch)
         {
-            cpu->fetch.has_insn = FALSE;
+            cpu->observers[i]->branch(cpu, stage, taken, cpu->observers[i]->ctx);
         }
+    }
+}
 
-    }else{
-        if (printMsg == 1)
+static void
+notify_memory(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int i;
+
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i]->memory)
         {
-           print_empty_content("Fetch", &cpu->fetch);
+            cpu->observers[i]->memory(cpu, stage, cpu->observers[i]->ctx);
         }
     }
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Fetch with an instruction cache or a fetch buffer. Up to fetch_width
+ * instructions a cycle go into the fetch buffer, which holds fetch_buffer
+ * instructions besides the one decode takes next, and decode takes the
+ * oldest whenever it is free. A fetch group ends after a predicted taken
+ * branch or HALT and, with the instruction cache, at the end of a cache
+ * line; the first instruction of a line waits for the cache access.
+ * Kept out of line so that it does not bloat the flattened cycle of the
+ * default front end.
  */
-static void
-APEX_decode(APEX_CPU *cpu, int printMsg)
+static APEX_NOINLINE void
+APEX_fetch_buffered(APEX_CPU *cpu, const int observed)
 {
-    if (cpu->decode.has_insn)
+    int fetched = 0;
+    int space, index, latency;
+
+    if (cpu->fetch.has_insn && cpu->fetch_from_next_cycle)
     {
-        cpu->is_waiting_fu = 0;
-        cpu->is_waiting_decode = 1;
-        int hasDest = 0;
-        int validInput = 0;
-        /* Read operands from register file based on the instruction type */
-        switch (cpu->decode.opcode)
+        cpu->fetch_from_next_cycle = FALSE;
+    }
+    else if (cpu->fetch.has_insn && cpu->fetch_stall > 0)
+    {
+        cpu->fetch_stall--;
+        cpu->fetch_icache_cycles++;
+    }
+    else if (cpu->fetch.has_insn)
+    {
+        space = cpu->config.fetch_buffer - cpu->fetch_count + !cpu->decode.has_insn;
+        if (space == 0)
         {
-            case OPCODE_MUL:
-            {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
-
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
-                }
+            cpu->fetch_blocked_cycles++;
+        }
 
-                //cpu->reg[cpu->decode.rd].valid = 1;
+        while (fetched < cpu->config.fetch_width && fetched < space)
+        {
+            CPU_Stage *entry;
 
-                if(cpu->is_waiting_mulFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0){
-                    validInput = 1;
-                }
-                hasDest = 1;
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
+            index = get_code_memory_index_from_pc(cpu->pc);
+            if (index < 0 || index >= cpu->code_memory_size)
+            {
                 break;
             }
-            case OPCODE_ADD:
-            case OPCODE_SUB:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            {
-            
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
 
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
+            if (cpu->config.icache.enabled && index >> cpu->icache.line_bits != cpu->fetch_line)
+            {
+                if (fetched)
+                {
+                    break;
                 }
 
-                //cpu->reg[cpu->decode.rd].valid = 1;
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
-                if(cpu->is_waiting_intFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0){
-                    validInput = 1;
+                cpu->fetch_line = index >> cpu->icache.line_bits;
+                latency = APEX_cache_access(&cpu->icache, NULL, index, FALSE, cpu->clock);
+                if (latency > 1)
+                {
+                    cpu->fetch_stall = latency - 2;
+                    cpu->fetch_icache_cycles++;
+                    break;
                 }
-                hasDest = 1;
-                break;
-            
             }
 
-            case OPCODE_CMP:
+            entry = &cpu->fetch_queue[(cpu->fetch_head + cpu->fetch_count) %
+                                      (MAX_FETCH_BUFFER + 1)];
+            entry->pc = cpu->pc;
+            entry->has_insn = TRUE;
+            entry->insn = &cpu->code_memory[index];
+            entry->predicted_taken = FALSE;
+            cpu->fetch_count++;
+            cpu->insn_fetched++;
+            fetched++;
+
+            cpu->pc += 4;
+            if (entry->insn->info->reads_zero)
             {
-            
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
-
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
-                }
+                int target;
 
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
-                if(cpu->is_waiting_intFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0){
-                    validInput = 1;
+                entry->predicted_taken = APEX_bpred_predict(&cpu->bpred, entry->pc, &target,
+                                                            &entry->bpred_ctx);
+                if (entry->predicted_taken)
+                {
+                    cpu->pc = target;
                 }
-                break;
-            
             }
 
-            case OPCODE_STORE:
+            if (observed)
             {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
-
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
-                }
+                notify_stage(cpu, "Fetch", entry, TRUE);
+            }
 
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0){
-                    validInput = 1;
-                }
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
-                if(cpu->is_waiting_loadFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
+            /* Stop fetching new instructions if HALT is fetched */
+            if (entry->insn->opcode == OPCODE_HALT)
+            {
+                cpu->fetch.has_insn = FALSE;
                 break;
             }
 
-            case OPCODE_LDR:
+            if (entry->predicted_taken)
             {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
+                break;
+            }
+        }
+    }
 
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
-                }
+    if (observed && !fetched)
+    {
+        notify_stage(cpu, "Fetch", &cpu->fetch, FALSE);
+    }
 
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0){
-                    validInput = 1;
-                }
+    /* Hand the oldest instruction to decode */
+    if (!cpu->decode.has_insn && cpu->fetch_count)
+    {
+        cpu->decode = cpu->fetch_queue[cpu->fetch_head];
+        cpu->fetch_head = (cpu->fetch_head + 1) % (MAX_FETCH_BUFFER + 1);
+        cpu->fetch_count--;
+    }
+}
 
-                //cpu->reg[cpu->decode.rd].valid = 1;
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
-                if(cpu->is_waiting_loadFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                hasDest = 1;
-                break;
-            }
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu, const int observed)
+{
 
-            case OPCODE_STR:
-            {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
+   // storing data in memory location 70
+   // cpu->data_memory[70] = 24;
+    int index;
 
-                if(cpu->reg[cpu->decode.rs2].valid == 0){
-                    cpu->decode.rs2_value = cpu->reg[cpu->decode.rs2].regs;
-                }
+    if (cpu->fetch_buffered)
+    {
+        APEX_fetch_buffered(cpu, observed);
+        return;
+    }
 
-                if(cpu->reg[cpu->decode.rs3].valid == 0){
-                    cpu->decode.rs3_value = cpu->reg[cpu->decode.rs3].regs;
-                }
+    if(cpu->is_waiting_decode == 1){
+        cpu->fetch_blocked_cycles++;
+        index = get_code_memory_index_from_pc(cpu->pc);
+        if (index >= 0 && index < cpu->code_memory_size)
+        {
+            cpu->fetch.insn = &cpu->code_memory[index];
+        }
+        if(observed){
+          notify_stage(cpu, "Fetch", &cpu->fetch, TRUE);
+        }        
+        return;
+    }
 
-                if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0 && cpu->reg[cpu->decode.rs3].valid == 0){
-                    validInput = 1;
-                }
-                /*cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];*/
-                if(cpu->is_waiting_loadFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                break;
-            }
+    if (cpu->fetch.has_insn) 
+    {
+        //cpu->is_waiting_fetch = 1;
+        /* This fetches new branch target instruction from next cycle */
+        if (cpu->fetch_from_next_cycle == TRUE)
+        {
+            cpu->fetch_from_next_cycle = FALSE;
 
-            case OPCODE_LOAD:
-            {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
-                //cpu->reg[cpu->decode.rd].valid = 1;
-                if(cpu->is_waiting_loadFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    validInput = 1;
-                }
-                hasDest = 1;
-                break;
-            }
+            /* Skip this cycle*/
+            return;
+        }
 
-            case OPCODE_MOVC:
-            case OPCODE_NOP:
+        /* Nothing to fetch past the end of the program; the pc may be on a
+         * wrong path, see APEX_fetch_fault */
+        index = get_code_memory_index_from_pc(cpu->pc);
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            if (observed)
             {
-                /* MOVC doesn't have register operands */
-                //cpu->reg[cpu->decode.rd].valid = 1; //setting destination register as not valid
-                if(cpu->is_waiting_intFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                validInput = 1;
-                hasDest = 1;
-                break;
+                notify_stage(cpu, "Fetch", &cpu->fetch, FALSE);
             }
+            return;
+        }
 
-            case OPCODE_ADDL:
-            case OPCODE_SUBL:
-            {
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    cpu->decode.rs1_value = cpu->reg[cpu->decode.rs1].regs;
-                }
-                //cpu->reg[cpu->decode.rd].valid = 1;
-                 if(cpu->is_waiting_intFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                if(cpu->reg[cpu->decode.rs1].valid == 0){
-                    validInput = 1;
-                }
-                hasDest = 1;
-                break;
-            }
+        /* Store current PC in fetch latch */
+        cpu->fetch.pc = cpu->pc;
+        cpu->insn_fetched++;
 
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            {
-                if(cpu->is_waiting_intFU == 1 || cpu->zero_flag_valid == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                validInput = 1;
-                break;
-            }
+        /* Index into code memory using this pc; the latch points at the
+         * decoded instruction instead of copying its fields */
+        cpu->fetch.insn = &cpu->code_memory[index];
+
+        /* Update PC for next instruction; branches continue on the path
+         * the predictor picks */
+        cpu->pc += 4;
+        if (cpu->fetch.insn->info->reads_zero)
+        {
+            int target;
 
-            case OPCODE_HALT:
+            cpu->fetch.predicted_taken = APEX_bpred_predict(&cpu->bpred, cpu->fetch.pc, &target,
+                                                            &cpu->fetch.bpred_ctx);
+            if (cpu->fetch.predicted_taken)
             {
-                if(cpu->is_waiting_intFU == 1){
-                    cpu->is_waiting_fu = 1;
-                }
-                validInput = 1;
-                break;
+                cpu->pc = target;
             }
         }
 
-        if (printMsg == 1)
-        {
-            print_stage_content("Decode/RF", &cpu->decode);
+        /* Copy data from fetch latch to decode latch*/
+        if(cpu->is_waiting_decode == 0){
+            cpu->decode = cpu->fetch;
         }
 
-        /*if(cpu->reg[cpu->decode.rs1].valid == 0 && cpu->reg[cpu->decode.rs2].valid == 0 && cpu->reg[cpu->decode.rs3].valid == 0 && cpu->is_waiting_fu == 0){
-             //Copy data from decode latch to execute latch
-            cpu->reg[cpu->decode.rd].valid = 1;
-            cpu->execute = cpu->decode;
-            cpu->decode.has_insn = FALSE;
-            cpu->is_waiting_decode = 0;
-            
-        }*/
-        if(validInput == 1){
-
-             if(hasDest == 1){
-                    cpu->reg[cpu->decode.rd].valid = 1;
-                }      
-            cpu->execute = cpu->decode;
-            cpu->decode.has_insn = FALSE;
-            cpu->is_waiting_decode = 0;
+        if (observed)
+        {
+           notify_stage(cpu, "Fetch", &cpu->fetch, TRUE);
         }
         
+        /* Stop fetching new instructions if HALT is fetched */
+        if (cpu->fetch.insn->opcode == OPCODE_HALT)
+        {
+            cpu->fetch.has_insn = FALSE;
+        }
+
     }else{
-        if (printMsg == 1)
+        if (observed)
         {
-            print_empty_content("Decode/RF", &cpu->decode);
+           notify_stage(cpu, "Fetch", &cpu->fetch, FALSE);
         }
     }
 }
 
-static void
-APEX_IntegerFU(APEX_CPU *cpu, int printMsg)
+/*
+ * Bypass network: the computed result of the in-flight instruction writing
+ * reg. Decode issues at most one writer per register, so there is at most
+ * one. It is in the writeback latch or, with FORWARD_ALL, in a functional
+ * unit slot it has spent its latency in while it waits for writeback.
+ * Returns NULL if the result is not available yet.
+ */
+static const CPU_Stage *
+APEX_bypass(APEX_CPU *cpu, int reg)
 {
+    int fu, i;
 
-    if (cpu->integerFU.has_insn)
+    for (i = 0; i < cpu->writeback_count; ++i)
     {
-        if(integerFUCounter == 1){
+        const CPU_Stage *done = &cpu->writeback[i];
 
-            cpu->is_waiting_intFU = 1;
-            /* Execute logic based on instruction type */
-            switch (cpu->integerFU.opcode)
-            {
-            case OPCODE_ADD:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value + cpu->integerFU.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                /*if (cpu->integerFU.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                cpu->zero_flag_valid = 1;
-                enqueue(1);
-                break;
-            }
-
-            case OPCODE_BZ:
-            {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->integerFU.pc + cpu->integerFU.imm;
+        if (done->insn->info->writes_rd && done->insn->rd == reg)
+        {
+            return done;
+        }
+    }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+    if (cpu->config.forwarding != FORWARD_ALL)
+    {
+        return NULL;
+    }
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        for (i = 0; i < cpu->fu_slots[fu]; ++i)
+        {
+            const CPU_Stage *slot = &cpu->fu[fu][i];
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                enqueue(1);
-                break;
+            if (slot->has_insn && slot->insn->info->writes_rd && slot->insn->rd == reg &&
+                cpu->fu_counter[fu][i] > slot->latency)
+            {
+                return slot;
             }
+        }
+    }
 
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->integerFU.pc + cpu->integerFU.imm;
+    return NULL;
+}
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+/*
+ * Reads source register reg into *value, from the register file or, if an
+ * older instruction is still writing it, from the bypass network. Returns
+ * the OPERAND_ source it came from, or -1 if it is not ready.
+ */
+static inline int
+APEX_read_operand(APEX_CPU *cpu, int reg, int *value)
+{
+    const CPU_Stage *producer;
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+    if (cpu->reg[reg].valid == 0)
+    {
+        *value = cpu->reg[reg].regs;
+        return OPERAND_REG_FILE;
+    }
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                enqueue(1);
-                break;
-            }
+    if (cpu->config.forwarding != FORWARD_NONE && (producer = APEX_bypass(cpu, reg)))
+    {
+        *value = producer->result_buffer;
+        return producer >= cpu->writeback && producer < cpu->writeback + MAX_ISSUE_WIDTH
+                   ? OPERAND_FROM_WRITEBACK
+                   : OPERAND_FROM_FU;
+    }
 
-            case OPCODE_MOVC:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.imm;
+    return -1;
+}
 
-                /* Set the zero flag based on the result buffer */
+/*
+ * First free slot of class fu in a unit that has not started an instruction
+ * this cycle (started has a bit per unit), or -1 if there is none. Each unit
+ * starts at most one instruction a cycle.
+ */
+static inline int
+APEX_fu_free_slot(const APEX_CPU *cpu, int fu, int started)
+{
+    int i;
 
-                // commenting below code since zero flag not applicable for MOVC
-                /*if (cpu->execute.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                enqueue(1);
-                break;
-            }
+    for (i = 0; i < cpu->fu_slots[fu]; ++i)
+    {
+        if (!cpu->fu[fu][i].has_insn && !(started >> (i / cpu->fu_depth[fu]) & 1))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
 
-            case OPCODE_ADDL:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value + cpu->integerFU.imm;
+/*
+ * Issues the instruction in the decode latch to the end of the execute
+ * latch once its operands are ready, a unit of its class is free and no
+ * older instruction is still writing its destination. grouped counts the
+ * instructions of each FU class issued before it in the same cycle.
+ * Returns TRUE if it issued.
+ */
+static inline int
+APEX_decode_insn(APEX_CPU *cpu, const int observed, const int *grouped)
+{
+    const APEX_OpInfo *info = cpu->decode.insn->info;
+    int sources[NUM_OPERAND_SOURCES] = {0};
+    int source = 0;
+    int zero_bypass = 0;
+    int i;
 
-                /* Set the zero flag based on the result buffer */
-                /*if (cpu->integerFU.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                cpu->zero_flag_valid = 1;
-                enqueue(1);
-                break;
-            }
+    /* Opcodes without a functional unit are never issued */
+    int validInput = (info->fu != FU_NONE);
 
-            case OPCODE_SUB:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value - cpu->integerFU.rs2_value;
+    cpu->is_waiting_decode = 1;
 
-                /* Set the zero flag based on the result buffer */
-                /*if (cpu->integerFU.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                cpu->zero_flag_valid = 1;
-                enqueue(1);
-                break;
-            }
+    /* Read the source operands; a source that an older instruction is
+     * still writing, and that cannot be forwarded yet, holds the
+     * instruction here */
+    if (info->sources & SRC_RS1)
+    {
+        source = APEX_read_operand(cpu, cpu->decode.insn->rs1, &cpu->decode.rs1_value);
+        if (source >= 0)
+        {
+            sources[source]++;
+        }
+    }
 
-            case OPCODE_SUBL:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value - cpu->integerFU.imm;
+    if (info->sources & SRC_RS2 && source >= 0)
+    {
+        source = APEX_read_operand(cpu, cpu->decode.insn->rs2, &cpu->decode.rs2_value);
+        if (source >= 0)
+        {
+            sources[source]++;
+        }
+    }
 
-                /* Set the zero flag based on the result buffer */
-                /*if (cpu->integerFU.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                cpu->zero_flag_valid = 1;
-                enqueue(1);
-                break;
-            }
+    if (info->sources & SRC_RS3 && source >= 0)
+    {
+        source = APEX_read_operand(cpu, cpu->decode.insn->rs3, &cpu->decode.rs3_value);
+        if (source >= 0)
+        {
+            sources[source]++;
+        }
+    }
 
-            case OPCODE_AND:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value & cpu->integerFU.rs2_value;
-                enqueue(1);
-                break;
-            }
+    if (source < 0)
+    {
+        validInput = 0;
+    }
 
-            case OPCODE_OR:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value | cpu->integerFU.rs2_value;
-                enqueue(1);
-                break;
-            }
+    /* With forwarding, a zero flag producer in the writeback latch
+     * writes the flag before the branch executes next cycle */
+    if (info->reads_zero && cpu->config.forwarding != FORWARD_NONE)
+    {
+        for (i = 0; i < cpu->writeback_count; ++i)
+        {
+            zero_bypass += cpu->writeback[i].insn->info->sets_zero;
+        }
+    }
 
-            case OPCODE_XOR:
-            {
-                cpu->integerFU.result_buffer = cpu->integerFU.rs1_value ^ cpu->integerFU.rs2_value;
-                enqueue(1);
-                break;
-            }
+    /* Wait for the functional unit to free up; branches also wait until
+     * every older zero flag producer has written back */
+    cpu->is_waiting_fu = cpu->fu_busy[info->fu] + grouped[info->fu] >= cpu->fu_slots[info->fu] ||
+                         (info->reads_zero && cpu->zero_flag_valid > zero_bypass);
 
-            case OPCODE_NOP:
-            {
-                enqueue(1);
-                break;
-            }
+    if (observed)
+    {
+        notify_stage(cpu, "Decode/RF", &cpu->decode, TRUE);
+    }
 
-            case OPCODE_CMP:
-            {
-                /*if (cpu->integerFU.rs1_value == cpu->integerFU.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }*/
-                cpu->zero_flag_valid = 1;
-                enqueue(1);
-                break;
-            }
+    /* Issue once the operands are ready, the functional unit is free and
+     * no older instruction is still writing the destination */
+    if(validInput == 1 && cpu->is_waiting_fu == 0 &&
+       !(info->writes_rd && cpu->reg[cpu->decode.insn->rd].valid == 1)){
 
-            case OPCODE_HALT:
-            {
-                enqueue(1);
-                break;
-            }
+         if(info->writes_rd){
+                cpu->reg[cpu->decode.insn->rd].valid = 1;
             }
-        }
-
-        if(integerFUCounter >= 1){
-            if(priorityQueue[front] == 1){
-                /* Copy data from execute latch to memory latch*/
-                cpu->writeback = cpu->integerFU;
-                cpu->integerFU.has_insn = FALSE;
-                integerFUCounter = 1;
-                cpu->is_waiting_intFU = 0;
-                cpu->zero_flag_valid = 0;
-                dequeue();
+         if(info->sets_zero){
+                cpu->zero_flag_valid++;
             }
-        }else{
-            integerFUCounter++;
-        }
-
-        if (printMsg == 1)
+        cpu->operands[OPERAND_REG_FILE] += sources[OPERAND_REG_FILE];
+        cpu->operands[OPERAND_FROM_WRITEBACK] += sources[OPERAND_FROM_WRITEBACK];
+        cpu->operands[OPERAND_FROM_FU] += sources[OPERAND_FROM_FU];
+        cpu->execute[cpu->execute_count++] = cpu->decode;
+        cpu->decode.has_insn = FALSE;
+        cpu->is_waiting_decode = 0;
+        if (cpu->bpred.recovering)
         {
-            print_stage_content("Integer FU", &cpu->integerFU);
+            cpu->bpred.lost_cycles += cpu->clock - cpu->bpred.redirect_clock;
+            cpu->bpred.recovering = FALSE;
         }
+        return TRUE;
+    }
 
-    }else{
-        if (printMsg == 1)
-        {
-           print_empty_content("Integer FU", &cpu->integerFU);
-        }
+    if (source < 0)
+    {
+        cpu->operand_stall_cycles++;
+    }
+    if (info->fu == FU_LS && cpu->config.lsq_size &&
+        cpu->fu_busy[FU_LS] == cpu->fu_slots[FU_LS])
+    {
+        cpu->lsq_full_cycles++;
+    }
+    if (observed)
+    {
+        notify_stall(cpu, &cpu->decode);
     }
-    
+    return FALSE;
 }
 
-static void
-APEX_MulFU(APEX_CPU *cpu, int printMsg)
+/*
+ * Decode with issue_width > 1: issues up to issue_width instructions in
+ * program order, taking each next one from the fetch buffer, and stops at
+ * the first that cannot issue. An instruction that depends on an older
+ * one of the group waits, as that one has marked its destination or the
+ * zero flag pending and its result is not on the bypass yet. A branch ends
+ * the group, since what follows it may be on the wrong path, and so does
+ * a load or store that would share the group with a store: units of a
+ * class start in slot order, not program order. Kept out of line like
+ * APEX_fetch_buffered.
+ */
+static APEX_NOINLINE void
+APEX_decode_superscalar(APEX_CPU *cpu, const int observed)
 {
-    if (cpu->multiplierFU.has_insn)
-    {
-        /* Execute logic based on instruction type */
-        if(mulFUCounter == 1){
-             cpu->is_waiting_mulFU = 1;
-            switch (cpu->multiplierFU.opcode)
-            {   
-                case OPCODE_MUL:
-                {
-                    cpu->multiplierFU.result_buffer = cpu->multiplierFU.rs1_value * cpu->multiplierFU.rs2_value;
-
-                    /* Set the zero flag based on the result buffer */
-                    /*
-                    if (cpu->multiplierFU.result_buffer == 0)
-                    {
-                       cpu->zero_flag = TRUE;
-                    } 
-                    else 
-                    {
-                       cpu->zero_flag = FALSE;
-                    }*/
-                    cpu->zero_flag_valid = 1;
-                    enqueue(2);
-                    break;
-                }
-
-            }
+    int grouped[NUM_FU_CLASSES] = {0};
+    int units[NUM_FU_CLASSES] = {0};
+    int group_store = FALSE;
+    int fu, slot, started;
 
+    /* Units of each class with a free slot; each can start one member */
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        started = 0;
+        while ((slot = APEX_fu_free_slot(cpu, fu, started)) >= 0)
+        {
+            started |= 1 << (slot / cpu->fu_depth[fu]);
+            units[fu]++;
         }
+    }
+
+    while (cpu->decode.has_insn && cpu->execute_count < cpu->config.issue_width)
+    {
+        const APEX_OpInfo *info = cpu->decode.insn->info;
+        int is_store = info->fu == FU_LS && !info->writes_rd;
 
-        if(mulFUCounter >= 3){
-            if(priorityQueue[front] == 2){
-                /* Copy data from multiplier FU latch to memory latch*/
-                cpu->writeback = cpu->multiplierFU;
-                cpu->multiplierFU.has_insn = FALSE;
-                mulFUCounter = 1;
-                cpu->is_waiting_mulFU = 0;
-                cpu->zero_flag_valid = 0;
-                dequeue();
+        if (grouped[info->fu] &&
+            (grouped[info->fu] == units[info->fu] ||
+             (info->fu == FU_LS && (is_store || group_store))))
+        {
+            if (observed)
+            {
+                notify_stage(cpu, "Decode/RF", &cpu->decode, TRUE);
             }
-        }else{
-            mulFUCounter++;
+            break;
         }
 
-        if (printMsg == 1)
+        if (!APEX_decode_insn(cpu, observed, grouped))
         {
-            print_stage_content("Multiplier FU", &cpu->multiplierFU);
+            break;
         }
-    }else{
-        if (printMsg == 1)
+
+        grouped[info->fu]++;
+        group_store |= is_store;
+        if (info->reads_zero || !cpu->fetch_count)
         {
-            print_empty_content("Multiplier FU", &cpu->multiplierFU);
+            break;
         }
+
+        cpu->decode = cpu->fetch_queue[cpu->fetch_head];
+        cpu->fetch_head = (cpu->fetch_head + 1) % (MAX_FETCH_BUFFER + 1);
+        cpu->fetch_count--;
     }
 
+    cpu->issue_cycles[cpu->execute_count]++;
+    if (observed && !cpu->execute_count && !cpu->decode.has_insn)
+    {
+        notify_stage(cpu, "Decode/RF", &cpu->decode, FALSE);
+    }
 }
 
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
 static void
-APEX_loadStoreFU(APEX_CPU *cpu, int printMsg)
+APEX_decode(APEX_CPU *cpu, const int observed)
 {
-    if (cpu->loadStoreFU.has_insn)
-    {
-        /* Execute logic based on instruction type */
-        if(loadStoreFUCounter == 1){
-            cpu->is_waiting_loadFU = 1;
-            switch (cpu->loadStoreFU.opcode)
-            {
-            case OPCODE_LOAD:
-            {
-                cpu->loadStoreFU.memory_address = cpu->loadStoreFU.rs1_value + cpu->loadStoreFU.imm;
+    static const int none[NUM_FU_CLASSES];
 
-                /* Read from data memory */
-                cpu->loadStoreFU.result_buffer = cpu->data_memory[cpu->loadStoreFU.memory_address];
-                enqueue(3);
-                break;
-            }
-
-            case OPCODE_STORE:
-            {
-                cpu->loadStoreFU.memory_address = cpu->loadStoreFU.rs2_value + cpu->loadStoreFU.imm;
+    if (cpu->config.issue_width > 1)
+    {
+        APEX_decode_superscalar(cpu, observed);
+    }
+    else if (cpu->decode.has_insn)
+    {
+        APEX_decode_insn(cpu, observed, none);
+    }else{
+        if (observed)
+        {
+            notify_stage(cpu, "Decode/RF", &cpu->decode, FALSE);
+        }
+    }
+}
 
-                /* Write to data memory */
-                cpu->data_memory[cpu->loadStoreFU.memory_address] = cpu->loadStoreFU.rs1_value;
-                enqueue(3);
-                break;
-            }
+/* Queue entry of each functional unit slot, and trace name of each unit */
+#define FU_SLOT_ID(fu, slot) ((fu) * MAX_FU_SLOTS + (slot))
 
-            case OPCODE_LDR:
-            {
-                cpu->loadStoreFU.memory_address = cpu->loadStoreFU.rs1_value + cpu->loadStoreFU.rs2_value;
+static const char *const fu_names[NUM_FU_CLASSES][MAX_FU_INSTANCES] = {
+    [FU_INT] = {"Integer FU", "Integer FU 2", "Integer FU 3", "Integer FU 4"},
+    [FU_MUL] = {"Multiplier FU", "Multiplier FU 2", "Multiplier FU 3", "Multiplier FU 4"},
+    [FU_LS] = {"Load/Store FU", "Load/Store FU 2", "Load/Store FU 3", "Load/Store FU 4"},
+};
 
-                /* Read from data memory */
-                cpu->loadStoreFU.result_buffer = cpu->data_memory[cpu->loadStoreFU.memory_address];
-                enqueue(3);
-                break;
-            }
+/* Moves the instruction in a functional unit slot, at the head of the
+ * writeback queue, to the writeback latch after cycles in the unit */
+static inline void
+APEX_fu_writeback(APEX_CPU *cpu, int fu, int slot, int cycles)
+{
+    int instance = slot / cpu->fu_depth[fu];
+
+    cpu->fu_ops[fu][instance]++;
+    cpu->fu_occupancy[fu][instance] += cycles;
+    cpu->writeback[cpu->writeback_count++] = cpu->fu[fu][slot];
+    cpu->fu[fu][slot].has_insn = FALSE;
+    cpu->fu_counter[fu][slot] = 1;
+    cpu->fu_busy[fu]--;
+    dequeue(cpu);
+}
 
-            case OPCODE_STR:
-            {
-                cpu->loadStoreFU.memory_address = cpu->loadStoreFU.rs1_value + cpu->loadStoreFU.rs2_value;
+/*
+ * Hands the instruction in a functional unit slot to writeback once it has
+ * spent its latency there, the slot is at the head of the writeback queue
+ * and the writeback latch has room for it this cycle. The counter keeps
+ * running while it waits so the instruction is not executed a second time.
+ */
+static void
+APEX_fu_complete(APEX_CPU *cpu, int fu, int slot)
+{
+    int *counter = &cpu->fu_counter[fu][slot];
 
-                /* Write to data memory */
-                cpu->data_memory[cpu->loadStoreFU.memory_address] = cpu->loadStoreFU.rs3_value;
-                enqueue(3);
-                break;
-            }
-            }
-        }
+    if (*counter >= cpu->fu[fu][slot].latency && cpu->writeback_count < cpu->config.issue_width &&
+        cpu->priorityQueue[cpu->front] == FU_SLOT_ID(fu, slot))
+    {
+        APEX_fu_writeback(cpu, fu, slot, *counter);
+    }
+    else
+    {
+        (*counter)++;
+    }
+}
 
-        if(loadStoreFUCounter >= 4){
-            if(priorityQueue[front] == 3){
-                /* Copy data from execute latch to memory latch*/
-                cpu->writeback = cpu->loadStoreFU;
-                cpu->loadStoreFU.has_insn = FALSE;
-                loadStoreFUCounter = 1;
-                cpu->is_waiting_loadFU = 0;
-                dequeue();
-            }  
-        }else{
-            loadStoreFUCounter++;
-        }
+/*
+ * With issue_width > 1, fills the rest of the writeback latch from the head
+ * of the writeback queue. A slot the class loop visited before the slot
+ * ahead of it in the queue left was not at the head then; if it had spent
+ * its latency, its counter has since moved past it.
+ */
+static APEX_NOINLINE void
+APEX_fu_drain(APEX_CPU *cpu)
+{
+    while (cpu->itemCount && cpu->writeback_count < cpu->config.issue_width)
+    {
+        int fu = cpu->priorityQueue[cpu->front] / MAX_FU_SLOTS;
+        int slot = cpu->priorityQueue[cpu->front] % MAX_FU_SLOTS;
 
-        if (printMsg == 1)
-        {
-            print_stage_content("Load/Store FU", &cpu->loadStoreFU);
-        }
-    }else{
-        if (printMsg == 1)
+        if (cpu->fu_counter[fu][slot] <= cpu->fu[fu][slot].latency)
         {
-            print_empty_content("Load/Store FU", &cpu->loadStoreFU);
+            return;
         }
+        APEX_fu_writeback(cpu, fu, slot, cpu->fu_counter[fu][slot] - 1);
     }
-    
 }
 
-static int
-APEX_execute(APEX_CPU *cpu, int printMsg)
+/* Mispredicted branch: redirect fetch to pc and flush the younger stages */
+static void
+APEX_branch_redirect(APEX_CPU *cpu, int pc)
 {
-    if(cpu->execute.has_insn){
-
-        switch(cpu->execute.opcode){
+    /* The bubble is counted until the right path issues; a redirect before
+     * then ends the previous one here */
+    if (cpu->bpred.recovering)
+    {
+        cpu->bpred.lost_cycles += cpu->clock - cpu->bpred.redirect_clock;
+    }
+    cpu->bpred.recovering = TRUE;
+    cpu->bpred.redirect_clock = cpu->clock;
 
-            case OPCODE_MUL:
-            {
-                cpu->multiplierFU = cpu->execute;
-                cpu->execute.has_insn = FALSE;
-                break;
-            }
+    /* Send the right path PC to fetch unit */
+    cpu->pc = pc;
 
-            case OPCODE_LOAD:
-            case OPCODE_STORE:
-            case OPCODE_LDR:
-            case OPCODE_STR:
-            {
-                cpu->loadStoreFU = cpu->execute;
-                cpu->execute.has_insn = FALSE;
-                break;
-            }
+    /* Since we are using reverse callbacks for pipeline stages,
+     * this will prevent the new instruction from being fetched in the current cycle*/
+    cpu->fetch_from_next_cycle = TRUE;
 
-            case OPCODE_ADD:
-            case OPCODE_BZ:
-            case OPCODE_BNZ:
-            case OPCODE_MOVC:
-            case OPCODE_ADDL:
-            case OPCODE_SUB:
-            case OPCODE_SUBL:
-            case OPCODE_AND:
-            case OPCODE_OR:
-            case OPCODE_XOR:
-            case OPCODE_NOP:
-            case OPCODE_CMP:
-            case OPCODE_HALT:
-            {
-                cpu->integerFU = cpu->execute;
-                cpu->execute.has_insn = FALSE;
-                break;
-            }
+    /* Flush previous stages */
+    cpu->decode.has_insn = FALSE;
+    cpu->is_waiting_decode = 0;
+    cpu->fetch_count = 0;
+    cpu->fetch_stall = 0;
+    cpu->fetch_line = -1;
 
-        }
-    }
-    APEX_IntegerFU(cpu, printMsg);
-    APEX_MulFU(cpu, printMsg);
-    APEX_loadStoreFU(cpu, printMsg);
-    return 0;
+    /* Make sure fetch stage is enabled to start fetching from new PC */
+    cpu->fetch.has_insn = TRUE;
 }
+
 /*
- * Writeback Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Resolves a branch: trains the predictor and, if fetch did not follow the
+ * actual direction, restarts it on the right path.
  */
-static int
-APEX_writeback(APEX_CPU *cpu, int printMsg)
+static void
+APEX_branch_resolve(APEX_CPU *cpu, const CPU_Stage *branch, int taken)
 {
-    if (cpu->writeback.has_insn)
+    int target = branch->pc + branch->insn->imm;
+
+    /* The FUs do not know whether the cycle is observed; branches are rare
+     * enough to check for observers here */
+    if (cpu->num_observers)
     {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
-        {
-            case OPCODE_ADD:
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                /* Set the zero flag based on the result buffer */
-                
-                if (cpu->writeback.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+        notify_branch(cpu, branch, taken);
+    }
 
-            case OPCODE_LOAD:
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+    cpu->bpred.branches++;
+    APEX_bpred_update(&cpu->bpred, branch->pc, branch->bpred_ctx, taken, target);
 
-            case OPCODE_LDR:
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+    if (taken != branch->predicted_taken)
+    {
+        cpu->bpred.mispredicts++;
+        cpu->bpred.squashed += (cpu->decode.has_insn ? 1 : 0) + cpu->fetch_count;
+        APEX_branch_redirect(cpu, taken ? target : branch->pc + 4);
+    }
+}
 
-            case OPCODE_MOVC: 
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+/* Operation of each FU class, performed in the first cycle in the unit */
+static void
+APEX_IntegerFU(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    /* Execute logic based on instruction type */
+    switch (stage->insn->opcode)
+    {
+        case OPCODE_ADD:
+            stage->result_buffer = stage->rs1_value + stage->rs2_value;
+            break;
 
-            case OPCODE_ADDL:
-            case OPCODE_SUB: 
-            case OPCODE_SUBL:  
-            case OPCODE_MUL:
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
+        case OPCODE_SUB:
+            stage->result_buffer = stage->rs1_value - stage->rs2_value;
+            break;
 
-                /* Set the zero flag based on the result buffer */
-                
-                if (cpu->writeback.result_buffer == 0)
-                {
-                    cpu->zero_flag = TRUE;
-                } 
-                else 
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                break;
-            }
+        case OPCODE_ADDL:
+            stage->result_buffer = stage->rs1_value + stage->insn->imm;
+            break;
 
-            case OPCODE_AND:
-            case OPCODE_OR: 
-            case OPCODE_XOR:
-            {
-                cpu->reg[cpu->writeback.rd].regs = cpu->writeback.result_buffer;
-                cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+        case OPCODE_SUBL:
+            stage->result_buffer = stage->rs1_value - stage->insn->imm;
+            break;
 
-            case OPCODE_NOP:
-            case OPCODE_STORE:
-            {
-                //cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+        case OPCODE_AND:
+            stage->result_buffer = stage->rs1_value & stage->rs2_value;
+            break;
 
-            case OPCODE_STR:
-            {
-                //cpu->reg[cpu->writeback.rd].valid = 0;
-                //cpu->reg[cpu->writeback.rs3].valid = 0;
-                break;
-            }
+        case OPCODE_OR:
+            stage->result_buffer = stage->rs1_value | stage->rs2_value;
+            break;
 
-            case OPCODE_CMP:
-            {
-                 if (cpu->writeback.rs1_value == cpu->writeback.rs2_value)
-                {
-                    cpu->zero_flag = TRUE;
-                }
-                else
-                {
-                    cpu->zero_flag = FALSE;
-                }
-                cpu->zero_flag_valid = 0;
-            }
-        }
+        case OPCODE_XOR:
+            stage->result_buffer = stage->rs1_value ^ stage->rs2_value;
+            break;
 
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
+        case OPCODE_MOVC:
+            stage->result_buffer = stage->insn->imm;
+            break;
 
-        if (printMsg == 1)
-        {
-           print_stage_content("Writeback", &cpu->writeback);
+        case OPCODE_CMP:
+            /* Zero when equal, so writeback sets the flag like any
+             * other zero flag producer */
+            stage->result_buffer = (stage->rs1_value == stage->rs2_value) ? 0 : 1;
+            break;
+
+        case OPCODE_BZ:
+            APEX_branch_resolve(cpu, stage, cpu->zero_flag == TRUE);
+            break;
+
+        case OPCODE_BNZ:
+            APEX_branch_resolve(cpu, stage, cpu->zero_flag == FALSE);
+            break;
+    }
+}
+
+static void
+APEX_MulFU(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    stage->result_buffer = stage->rs1_value * stage->rs2_value;
+}
+
+/*
+ * Load/store queue: the youngest store in the queue to the address load
+ * reads, or NULL, with the cycles it still has to spend there in
+ * *remaining. Every other entry is older than load, which has just
+ * started, as decode issues in order and one instruction a cycle.
+ */
+static const CPU_Stage *
+APEX_lsq_match(APEX_CPU *cpu, const CPU_Stage *load, int *remaining)
+{
+    const CPU_Stage *match = NULL;
+    int i, youngest = 0;
+
+    for (i = 0; i < cpu->fu_slots[FU_LS]; ++i)
+    {
+        const CPU_Stage *entry = &cpu->fu[FU_LS][i];
+
+        if (entry != load && entry->has_insn && !entry->insn->info->writes_rd &&
+            entry->memory_address == load->memory_address &&
+            (!match || cpu->fu_counter[FU_LS][i] < youngest))
+        {
+            match = entry;
+            youngest = cpu->fu_counter[FU_LS][i];
+        }
+    }
+
+    if (match)
+    {
+        *remaining = match->latency > youngest ? match->latency - youngest : 0;
+    }
+    return match;
+}
+
+/*
+ * With the data cache enabled the cache, or else with the DRAM model main
+ * memory, decides how long a load or store stays in the unit instead of
+ * ls_fu_latency. The prefetcher, if any, then learns from the access.
+ */
+static void
+APEX_memory_timing(APEX_CPU *cpu, CPU_Stage *stage, int is_write)
+{
+    if (cpu->config.dcache.enabled)
+    {
+        APEX_Memory *memory = cpu->config.memory == MEMORY_DRAM ? &cpu->memory : NULL;
+
+        stage->latency = APEX_cache_access(&cpu->dcache, memory, stage->memory_address, is_write,
+                                           cpu->clock);
+        if (cpu->config.prefetch != PREFETCH_NONE)
+        {
+            APEX_prefetch_access(&cpu->prefetch, &cpu->dcache, memory, stage->pc,
+                                 stage->memory_address, cpu->clock);
+        }
+    }
+    else if (cpu->config.memory == MEMORY_DRAM)
+    {
+        stage->latency = APEX_memory_access(&cpu->memory, stage->memory_address, is_write,
+                                            cpu->clock);
+    }
+}
+
+/*
+ * Loads and stores access data memory at once, and APEX_memory_timing
+ * decides how long they take. An address outside data memory is not
+ * accessed; APEX_writeback stops the run when the instruction gets there.
+ *
+ * With the load/store queue, a load to the address of a store still in the
+ * queue takes the store's data in lsq_forward_latency cycles, or, without
+ * forwarding, waits for the store before it accesses memory.
+ */
+static void
+APEX_loadStoreFU(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int is_write = FALSE;
+    int conflict = 0;
+    int value = 0;
+
+    /* Execute logic based on instruction type */
+    switch (stage->insn->opcode)
+    {
+        case OPCODE_LOAD:
+            stage->memory_address = stage->rs1_value + stage->insn->imm;
+            break;
+
+        case OPCODE_STORE:
+            stage->memory_address = stage->rs2_value + stage->insn->imm;
+            value = stage->rs1_value;
+            is_write = TRUE;
+            break;
+
+        case OPCODE_LDR:
+            stage->memory_address = stage->rs1_value + stage->rs2_value;
+            break;
+
+        case OPCODE_STR:
+            stage->memory_address = stage->rs1_value + stage->rs2_value;
+            value = stage->rs3_value;
+            is_write = TRUE;
+            break;
+    }
+
+    if (stage->memory_address >= 0 && stage->memory_address < DATA_MEMORY_SIZE)
+    {
+        if (is_write)
+        {
+            cpu->data_memory[stage->memory_address] = value;
+        }
+        else
+        {
+            stage->result_buffer = cpu->data_memory[stage->memory_address];
+        }
+    }
+
+    if (cpu->config.lsq_size)
+    {
+        if (is_write)
+        {
+            cpu->lsq_stores++;
+        }
+        else
+        {
+            cpu->lsq_loads++;
+            if (APEX_lsq_match(cpu, stage, &conflict))
+            {
+                cpu->lsq_conflicts++;
+                if (cpu->config.lsq_forwarding)
+                {
+                    cpu->lsq_forwarded++;
+                    stage->latency = cpu->config.lsq_forward_latency;
+                    return;
+                }
+            }
+        }
+    }
+
+    APEX_memory_timing(cpu, stage, is_write);
+    stage->latency += conflict;
+}
+
+/*
+ * One cycle of one functional unit slot. Returns TRUE if it held an
+ * instruction; empty slots are only traced when the unit is not pipelined.
+ */
+static inline int
+APEX_fu_cycle(APEX_CPU *cpu, int fu, int slot, const int observed)
+{
+    CPU_Stage *stage = &cpu->fu[fu][slot];
+
+    if (stage->has_insn)
+    {
+        if (cpu->fu_counter[fu][slot] == 1)
+        {
+            cpu->fu_busy[fu]++;
+            stage->latency = cpu->config.fu_latency[fu];
+            switch (fu)
+            {
+                case FU_INT:
+                    APEX_IntegerFU(cpu, stage);
+                    break;
+
+                case FU_MUL:
+                    APEX_MulFU(cpu, stage);
+                    break;
+
+                case FU_LS:
+                    APEX_loadStoreFU(cpu, stage);
+                    if (observed)
+                    {
+                        notify_memory(cpu, stage);
+                    }
+                    break;
+            }
+            if (cpu->config.issue_width == 1)
+            {
+                enqueue(cpu, FU_SLOT_ID(fu, slot));
+            }
+        }
+
+        APEX_fu_complete(cpu, fu, slot);
+
+        if (observed)
+        {
+            notify_stage(cpu, fu_names[fu][slot / cpu->fu_depth[fu]], stage, TRUE);
+        }
+        return TRUE;
+    }
+
+    if (observed && cpu->fu_depth[fu] == 1)
+    {
+        notify_stage(cpu, fu_names[fu][slot], stage, FALSE);
+    }
+    return FALSE;
+}
+
+static inline void
+APEX_fu_class_cycle(APEX_CPU *cpu, const int fu, const int observed)
+{
+    int i, busy;
+
+    /* The common single unit case gets its own copy with a constant index */
+    if (cpu->fu_slots[fu] == 1)
+    {
+        APEX_fu_cycle(cpu, fu, 0, observed);
+        return;
+    }
+
+    busy = FALSE;
+    for (i = 0; i < cpu->fu_slots[fu]; ++i)
+    {
+        busy |= APEX_fu_cycle(cpu, fu, i, observed);
+
+        /* A pipelined unit traces one line per instruction in flight, or a
+         * single EMPTY line */
+        if (cpu->fu_depth[fu] > 1 && (i + 1) % cpu->fu_depth[fu] == 0)
+        {
+            if (observed && !busy)
+            {
+                notify_stage(cpu, fu_names[fu][i / cpu->fu_depth[fu]], &cpu->fu[fu][i], FALSE);
+            }
+            busy = FALSE;
+        }
+    }
+}
+
+static int
+APEX_execute(APEX_CPU *cpu, const int observed)
+{
+    int started[NUM_FU_CLASSES] = {0};
+    int i, n;
+
+    /* Decode only issues when a unit of the class that has not started an
+     * instruction this cycle has a free slot. A slot joins the writeback
+     * queue when its unit starts the instruction; the units of an issue
+     * group start in class order, so the group joins here, in program
+     * order, instead */
+    for (n = 0; n < cpu->execute_count; ++n)
+    {
+        const int fu = cpu->execute[n].insn->info->fu;
+
+        i = APEX_fu_free_slot(cpu, fu, started[fu]);
+        started[fu] |= 1 << (i / cpu->fu_depth[fu]);
+        cpu->fu[fu][i] = cpu->execute[n];
+        if (cpu->config.issue_width > 1)
+        {
+            enqueue(cpu, FU_SLOT_ID(fu, i));
+        }
+    }
+    cpu->execute_count = 0;
+
+    /* One call per class so each is specialized for its operation */
+    APEX_fu_class_cycle(cpu, FU_INT, observed);
+    APEX_fu_class_cycle(cpu, FU_MUL, observed);
+    APEX_fu_class_cycle(cpu, FU_LS, observed);
+
+    if (cpu->config.issue_width > 1)
+    {
+        APEX_fu_drain(cpu);
+    }
+    return 0;
+}
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Returns APEX_SIM_HALTED once HALT has written back, APEX_SIM_FAULT, with
+ * pc on the instruction, for a load or store outside data memory, and 0
+ * otherwise.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu, const int observed)
+{
+    int i, halted = 0;
+
+    /* Up to issue_width instructions, oldest first */
+    for (i = 0; i < cpu->writeback_count; ++i)
+    {
+        const CPU_Stage *stage = &cpu->writeback[i];
+        const APEX_OpInfo *info = stage->insn->info;
+
+        if (info->fu == FU_LS &&
+            (stage->memory_address < 0 || stage->memory_address >= DATA_MEMORY_SIZE))
+        {
+            fprintf(stderr, "APEX_Error: pc(%d) %s accesses MEM[%d] outside data memory\n",
+                    stage->pc, info->mnemonic, stage->memory_address);
+            cpu->pc = stage->pc;
+            return APEX_SIM_FAULT;
+        }
+
+        /* Write result to register file */
+        if (info->writes_rd)
+        {
+            cpu->reg[stage->insn->rd].regs = stage->result_buffer;
+            cpu->reg[stage->insn->rd].valid = 0;
+        }
+
+        /* Set the zero flag based on the result buffer */
+        if (info->sets_zero)
+        {
+            cpu->zero_flag = (stage->result_buffer == 0) ? TRUE : FALSE;
+            cpu->zero_flag_valid--;
+        }
+
+        cpu->insn_completed++;
+
+        if (observed)
+        {
+            notify_retire(cpu, stage);
         }
 
-        if (cpu->writeback.opcode == OPCODE_HALT)
+        if (observed)
+        {
+           notify_stage(cpu, "Writeback", stage, TRUE);
+        }
+
+        if (stage->insn->opcode == OPCODE_HALT)
         {
             /* Stop the APEX simulator */
-            return TRUE;
+            halted = APEX_SIM_HALTED;
+        }
+    }
+
+    if (cpu->writeback_count == 0 && observed)
+    {
+        notify_stage(cpu, "Writeback", &cpu->writeback[0], FALSE);
+    }
+    cpu->writeback_count = 0;
+
+    return halted;
+}
+
+/*
+ * Out-of-order core, used instead of decode, execute and writeback when
+ * config.ooo is set. Fetch is shared with the in-order pipeline.
+ *
+ * Rename takes up to ooo_width instructions a cycle from the decode latch
+ * (and the fetch buffer behind it), maps their sources through the rename
+ * table, gives each result a free physical register and puts them in the
+ * reorder buffer (ROB) and the issue queue. Issue picks, oldest first, the
+ * instructions whose sources are ready, as many per class as it has units
+ * with a free slot, and execute runs them in the functional units as
+ * usual. A result is broadcast to the physical register file when it has
+ * spent its latency, so dependents issue in the same cycle and start in
+ * the next. Commit retires up to ooo_width completed instructions a cycle
+ * from the head of the ROB in program order: it updates the architectural
+ * registers and zero flag, writes stores to data memory and frees the
+ * physical registers the committed ones replaced.
+ *
+ * The zero flag is renamed with the registers: a zero flag producer maps it
+ * to its result register and a branch reads that. A mispredicted branch
+ * resolves in the integer FU, squashes everything younger and restores the
+ * rename table it saved at rename. A load issues once every older store
+ * has computed its address and takes the data of the youngest older store
+ * to the same address, if any, in lsq_forward_latency cycles.
+ */
+
+/* Physical register for a new result, or -1 if none is free */
+static int
+ooo_alloc(APEX_OoO *ooo)
+{
+    int reg;
+
+    if (ooo->free_count == 0)
+    {
+        return -1;
+    }
+
+    reg = ooo->free_list[--ooo->free_count];
+    ooo->prf_ready[reg] = FALSE;
+    ooo->prf_refs[reg] = 0;
+    return reg;
+}
+
+static void
+ooo_release(APEX_OoO *ooo, int reg)
+{
+    ooo->free_list[ooo->free_count++] = reg;
+}
+
+/* A committed instruction maps name to reg; the register it replaces is
+ * freed once no committed name maps to it */
+static void
+ooo_commit_map(APEX_OoO *ooo, int name, int reg)
+{
+    int old = ooo->commit_rat[name];
+
+    ooo->commit_rat[name] = reg;
+    ooo->prf_refs[reg]++;
+    if (--ooo->prf_refs[old] == 0)
+    {
+        ooo_release(ooo, old);
+    }
+}
+
+/* Maps every name to a physical register holding its architectural value,
+ * with the others free, and empties the ROB and issue queue */
+static void
+APEX_ooo_reset(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int i;
+
+    memset(ooo, 0, sizeof(*ooo));
+    for (i = 0; i < NUM_ARCH_REGS; ++i)
+    {
+        ooo->rat[i] = ooo->commit_rat[i] = i;
+        ooo->prf_value[i] = i == ARCH_ZERO_FLAG ? !cpu->zero_flag : cpu->reg[i].regs;
+        ooo->prf_ready[i] = TRUE;
+        ooo->prf_refs[i] = 1;
+    }
+
+    for (i = cpu->config.phys_regs - 1; i >= NUM_ARCH_REGS; --i)
+    {
+        ooo_release(ooo, i);
+    }
+}
+
+/* Index of the ROB entry n places after entry */
+static inline int
+ooo_rob_next(int entry, int n)
+{
+    return (entry + n) % MAX_ROB_SIZE;
+}
+
+/*
+ * Mispredicted branch: drops every younger instruction from the ROB, the
+ * issue queue and the functional units, frees their physical registers and
+ * restores the rename table of the branch. Returns how many were dropped.
+ */
+static int
+ooo_squash(APEX_CPU *cpu, const APEX_ROB_Entry *branch)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int fu, i, kept, squashed = 0;
+
+    while (ooo->rob_count)
+    {
+        APEX_ROB_Entry *entry = &ooo->rob[ooo_rob_next(ooo->rob_head, ooo->rob_count - 1)];
+
+        if (entry == branch)
+        {
+            break;
+        }
+
+        if (entry->dest >= 0)
+        {
+            ooo_release(ooo, entry->dest);
+        }
+        ooo->rob_count--;
+        squashed++;
+    }
+    memcpy(ooo->rat, branch->rat, sizeof(ooo->rat));
+
+    for (i = 0, kept = 0; i < ooo->iq_count; ++i)
+    {
+        if (ooo->rob[ooo->iq[i]].seq < branch->seq)
+        {
+            ooo->iq[kept++] = ooo->iq[i];
+        }
+    }
+    ooo->iq_count = kept;
+
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        for (i = 0; i < cpu->fu_slots[fu]; ++i)
+        {
+            if (cpu->fu[fu][i].has_insn && ooo->rob[ooo->fu_rob[fu][i]].seq > branch->seq)
+            {
+                cpu->fu[fu][i].has_insn = FALSE;
+                cpu->fu_counter[fu][i] = 1;
+                cpu->fu_busy[fu]--;
+            }
         }
+    }
+
+    return squashed;
+}
+
+/* Resolves a branch like APEX_branch_resolve, with the renamed zero flag */
+static void
+ooo_branch_resolve(APEX_CPU *cpu, APEX_ROB_Entry *entry, const CPU_Stage *branch)
+{
+    int zero = cpu->ooo.prf_value[entry->zero_src] == 0;
+    int taken = branch->insn->opcode == OPCODE_BZ ? zero : !zero;
+    int target = branch->pc + branch->insn->imm;
+
+    if (cpu->num_observers)
+    {
+        notify_branch(cpu, branch, taken);
+    }
+
+    cpu->bpred.branches++;
+    APEX_bpred_update(&cpu->bpred, branch->pc, branch->bpred_ctx, taken, target);
+
+    if (taken != branch->predicted_taken)
+    {
+        cpu->bpred.mispredicts++;
+        cpu->bpred.squashed += ooo_squash(cpu, entry) + (cpu->decode.has_insn ? 1 : 0) +
+                               cpu->fetch_count;
+        APEX_branch_redirect(cpu, taken ? target : branch->pc + 4);
+    }
+}
+
+/*
+ * Loads and stores compute their address; stores keep their data in
+ * result_buffer until they commit. A load takes the data of the youngest
+ * older store to its address, which has executed as loads wait for all of
+ * them, or reads data memory; a wrong path load may have an address outside
+ * it and reads 0.
+ */
+static void
+ooo_load_store(APEX_CPU *cpu, const APEX_ROB_Entry *entry, CPU_Stage *stage)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int index;
+
+    switch (stage->insn->opcode)
+    {
+        case OPCODE_STORE:
+            stage->memory_address = stage->rs2_value + stage->insn->imm;
+            stage->result_buffer = stage->rs1_value;
+            APEX_memory_timing(cpu, stage, TRUE);
+            return;
+
+        case OPCODE_STR:
+            stage->memory_address = stage->rs1_value + stage->rs2_value;
+            stage->result_buffer = stage->rs3_value;
+            APEX_memory_timing(cpu, stage, TRUE);
+            return;
+
+        case OPCODE_LOAD:
+            stage->memory_address = stage->rs1_value + stage->insn->imm;
+            break;
+
+        case OPCODE_LDR:
+            stage->memory_address = stage->rs1_value + stage->rs2_value;
+            break;
+    }
+
+    index = entry - ooo->rob;
+    while (index != ooo->rob_head)
+    {
+        const APEX_ROB_Entry *older;
+
+        index = (index + MAX_ROB_SIZE - 1) % MAX_ROB_SIZE;
+        older = &ooo->rob[index];
+        if (!older->stage.insn->info->writes_rd && older->stage.insn->info->fu == FU_LS &&
+            older->stage.memory_address == stage->memory_address)
+        {
+            ooo->loads_forwarded++;
+            stage->result_buffer = older->stage.result_buffer;
+            stage->latency = cpu->config.lsq_forward_latency;
+            return;
+        }
+    }
+
+    stage->result_buffer = stage->memory_address >= 0 &&
+                                   stage->memory_address < DATA_MEMORY_SIZE
+                               ? cpu->data_memory[stage->memory_address]
+                               : 0;
+    APEX_memory_timing(cpu, stage, FALSE);
+}
+
+/* One cycle of one functional unit slot; see APEX_fu_cycle */
+static int
+ooo_fu_cycle(APEX_CPU *cpu, int fu, int slot, const int observed)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    CPU_Stage *stage = &cpu->fu[fu][slot];
+    int *counter = &cpu->fu_counter[fu][slot];
+    APEX_ROB_Entry *entry;
+
+    if (!stage->has_insn)
+    {
+        if (observed && cpu->fu_depth[fu] == 1)
+        {
+            notify_stage(cpu, fu_names[fu][slot], stage, FALSE);
+        }
+        return FALSE;
+    }
+
+    entry = &ooo->rob[ooo->fu_rob[fu][slot]];
+    if (*counter == 1)
+    {
+        stage->latency = cpu->config.fu_latency[fu];
+        switch (fu)
+        {
+            case FU_INT:
+                if (stage->insn->info->reads_zero)
+                {
+                    ooo_branch_resolve(cpu, entry, stage);
+                }
+                else
+                {
+                    APEX_IntegerFU(cpu, stage);
+                }
+                break;
+
+            case FU_MUL:
+                APEX_MulFU(cpu, stage);
+                break;
+
+            case FU_LS:
+                ooo_load_store(cpu, entry, stage);
+                if (observed)
+                {
+                    notify_memory(cpu, stage);
+                }
+                break;
+        }
+        entry->stage = *stage;
+        entry->executed = TRUE;
+    }
+
+    if (*counter >= stage->latency)
+    {
+        int instance = slot / cpu->fu_depth[fu];
+
+        if (entry->dest >= 0)
+        {
+            ooo->prf_value[entry->dest] = stage->result_buffer;
+            ooo->prf_ready[entry->dest] = TRUE;
+        }
+        entry->completed = TRUE;
+        cpu->fu_ops[fu][instance]++;
+        cpu->fu_occupancy[fu][instance] += *counter;
+        stage->has_insn = FALSE;
+        *counter = 1;
+        cpu->fu_busy[fu]--;
+    }
+    else
+    {
+        (*counter)++;
+    }
+
+    if (observed)
+    {
+        notify_stage(cpu, fu_names[fu][slot / cpu->fu_depth[fu]], stage, TRUE);
+    }
+    return TRUE;
+}
+
+/* Every functional unit slot, traced like APEX_fu_class_cycle */
+static void
+APEX_ooo_execute(APEX_CPU *cpu, const int observed)
+{
+    int fu, i, busy;
+
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        busy = FALSE;
+        for (i = 0; i < cpu->fu_slots[fu]; ++i)
+        {
+            busy |= ooo_fu_cycle(cpu, fu, i, observed);
+            if (cpu->fu_depth[fu] > 1 && (i + 1) % cpu->fu_depth[fu] == 0)
+            {
+                if (observed && !busy)
+                {
+                    notify_stage(cpu, fu_names[fu][i / cpu->fu_depth[fu]], &cpu->fu[fu][i],
+                                 FALSE);
+                }
+                busy = FALSE;
+            }
+        }
+    }
+}
+
+/* Sources are ready; loads also wait for the addresses of older stores */
+static int
+ooo_ready(const APEX_OoO *ooo, const APEX_ROB_Entry *entry, long long store_seq)
+{
+    int i;
+
+    for (i = 0; i < 3; ++i)
+    {
+        if (entry->src[i] >= 0 && !ooo->prf_ready[entry->src[i]])
+        {
+            return FALSE;
+        }
+    }
+
+    if (entry->zero_src >= 0 && !ooo->prf_ready[entry->zero_src])
+    {
+        return FALSE;
+    }
+
+    return !(entry->stage.insn->info->fu == FU_LS && entry->stage.insn->info->writes_rd &&
+             entry->seq > store_seq);
+}
+
+/* Wakeup and select: sends the oldest ready instructions to free units,
+ * each of which starts at most one a cycle */
+static void
+APEX_ooo_issue(APEX_CPU *cpu)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int started[NUM_FU_CLASSES] = {0};
+    long long store_seq = ooo->seq;
+    int i, n, slot;
+
+    /* Program order of the oldest store that has not executed, if any */
+    for (n = 0; n < ooo->rob_count; ++n)
+    {
+        const APEX_ROB_Entry *entry = &ooo->rob[ooo_rob_next(ooo->rob_head, n)];
+
+        if (!entry->executed && entry->stage.insn->info->fu == FU_LS &&
+            !entry->stage.insn->info->writes_rd)
+        {
+            store_seq = entry->seq;
+            break;
+        }
+    }
+
+    i = 0;
+    while (i < ooo->iq_count)
+    {
+        APEX_ROB_Entry *entry = &ooo->rob[ooo->iq[i]];
+        int fu = entry->stage.insn->info->fu;
+
+        if (cpu->fu_busy[fu] == cpu->fu_slots[fu] ||
+            (slot = APEX_fu_free_slot(cpu, fu, started[fu])) < 0 ||
+            !ooo_ready(ooo, entry, store_seq))
+        {
+            i++;
+            continue;
+        }
+
+        if (entry->src[0] >= 0)
+        {
+            entry->stage.rs1_value = ooo->prf_value[entry->src[0]];
+        }
+        if (entry->src[1] >= 0)
+        {
+            entry->stage.rs2_value = ooo->prf_value[entry->src[1]];
+        }
+        if (entry->src[2] >= 0)
+        {
+            entry->stage.rs3_value = ooo->prf_value[entry->src[2]];
+        }
+
+        cpu->fu[fu][slot] = entry->stage;
+        ooo->fu_rob[fu][slot] = ooo->iq[i];
+        cpu->fu_busy[fu]++;
+        started[fu] |= 1 << (slot / cpu->fu_depth[fu]);
+        ooo->issued++;
+
+        memmove(&ooo->iq[i], &ooo->iq[i + 1], (ooo->iq_count - i - 1) * sizeof(ooo->iq[0]));
+        ooo->iq_count--;
+    }
+}
+
+/* Register renaming and dispatch into the ROB and issue queue */
+static void
+APEX_ooo_rename(APEX_CPU *cpu, const int observed)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int renamed = 0;
+
+    while (cpu->decode.has_insn && renamed < cpu->config.ooo_width)
+    {
+        const APEX_Instruction *insn = cpu->decode.insn;
+        const APEX_OpInfo *info = insn->info;
+        int needs_dest = info->writes_rd || info->sets_zero;
+        APEX_ROB_Entry *entry;
+        int index;
+
+        /* Opcodes without a functional unit are never issued */
+        if (info->fu == FU_NONE || ooo->rob_count == cpu->config.rob_size ||
+            ooo->iq_count == cpu->config.iq_size || (needs_dest && ooo->free_count == 0))
+        {
+            if (ooo->rob_count == cpu->config.rob_size)
+            {
+                ooo->rob_full_cycles++;
+            }
+            else if (ooo->iq_count == cpu->config.iq_size)
+            {
+                ooo->iq_full_cycles++;
+            }
+            else if (info->fu != FU_NONE)
+            {
+                ooo->regs_full_cycles++;
+            }
+
+            if (observed)
+            {
+                notify_stage(cpu, "Rename", &cpu->decode, TRUE);
+                notify_stall(cpu, &cpu->decode);
+            }
+            break;
+        }
+
+        if (cpu->bpred.recovering)
+        {
+            cpu->bpred.lost_cycles += cpu->clock - cpu->bpred.redirect_clock;
+            cpu->bpred.recovering = FALSE;
+        }
+
+        index = ooo_rob_next(ooo->rob_head, ooo->rob_count++);
+        entry = &ooo->rob[index];
+        entry->stage = cpu->decode;
+        entry->seq = ooo->seq++;
+        entry->src[0] = info->sources & SRC_RS1 ? ooo->rat[insn->rs1] : -1;
+        entry->src[1] = info->sources & SRC_RS2 ? ooo->rat[insn->rs2] : -1;
+        entry->src[2] = info->sources & SRC_RS3 ? ooo->rat[insn->rs3] : -1;
+        entry->zero_src = info->reads_zero ? ooo->rat[ARCH_ZERO_FLAG] : -1;
+        entry->dest = needs_dest ? ooo_alloc(ooo) : -1;
+        entry->executed = FALSE;
+        entry->completed = FALSE;
+
+        if (info->writes_rd)
+        {
+            ooo->rat[insn->rd] = entry->dest;
+        }
+        if (info->sets_zero)
+        {
+            ooo->rat[ARCH_ZERO_FLAG] = entry->dest;
+        }
+        if (info->reads_zero)
+        {
+            memcpy(entry->rat, ooo->rat, sizeof(entry->rat));
+        }
+        ooo->iq[ooo->iq_count++] = index;
+
+        if (observed)
+        {
+            notify_stage(cpu, "Rename", &cpu->decode, TRUE);
+        }
+        renamed++;
+
+        /* The next instruction, from the fetch buffer if there is one */
+        cpu->decode.has_insn = FALSE;
+        if (cpu->fetch_count)
+        {
+            cpu->decode = cpu->fetch_queue[cpu->fetch_head];
+            cpu->fetch_head = (cpu->fetch_head + 1) % (MAX_FETCH_BUFFER + 1);
+            cpu->fetch_count--;
+        }
+    }
+
+    if (observed && !renamed && !cpu->decode.has_insn)
+    {
+        notify_stage(cpu, "Rename", &cpu->decode, FALSE);
+    }
+
+    /* Fetch holds its instruction while the decode latch is full */
+    cpu->is_waiting_decode = cpu->decode.has_insn;
+}
+
+/*
+ * Retires completed instructions in program order. Returns APEX_SIM_HALTED
+ * once HALT has, APEX_SIM_FAULT, with pc on the instruction, when a load or
+ * store about to retire lies outside data memory, and 0 otherwise.
+ */
+static int
+APEX_ooo_commit(APEX_CPU *cpu, const int observed)
+{
+    APEX_OoO *ooo = &cpu->ooo;
+    int committed = 0;
+
+    while (ooo->rob_count && committed < cpu->config.ooo_width)
+    {
+        APEX_ROB_Entry *entry = &ooo->rob[ooo->rob_head];
+        const APEX_Instruction *insn = entry->stage.insn;
+
+        if (!entry->completed)
+        {
+            break;
+        }
+
+        if (insn->info->fu == FU_LS &&
+            (entry->stage.memory_address < 0 || entry->stage.memory_address >= DATA_MEMORY_SIZE))
+        {
+            fprintf(stderr, "APEX_Error: pc(%d) %s accesses MEM[%d] outside data memory\n",
+                    entry->stage.pc, insn->info->mnemonic, entry->stage.memory_address);
+            cpu->pc = entry->stage.pc;
+            return APEX_SIM_FAULT;
+        }
+
+        if (insn->info->writes_rd)
+        {
+            ooo_commit_map(ooo, insn->rd, entry->dest);
+            cpu->reg[insn->rd].regs = entry->stage.result_buffer;
+        }
+        if (insn->info->sets_zero)
+        {
+            ooo_commit_map(ooo, ARCH_ZERO_FLAG, entry->dest);
+            cpu->zero_flag = (entry->stage.result_buffer == 0) ? TRUE : FALSE;
+        }
+        if (insn->info->fu == FU_LS && !insn->info->writes_rd)
+        {
+            cpu->data_memory[entry->stage.memory_address] = entry->stage.result_buffer;
+        }
+
+        ooo->rob_head = ooo_rob_next(ooo->rob_head, 1);
+        ooo->rob_count--;
+        cpu->insn_completed++;
+        committed++;
+
+        if (observed)
+        {
+            notify_retire(cpu, &entry->stage);
+            notify_stage(cpu, "Commit", &entry->stage, TRUE);
+        }
+
+        if (insn->opcode == OPCODE_HALT)
+        {
+            return APEX_SIM_HALTED;
+        }
+    }
+
+    if (observed && !committed)
+    {
+        notify_stage(cpu, "Commit", &cpu->writeback[0], FALSE);
+    }
+    return 0;
+}
+
+/*
+ * Fetch stops at a pc outside code memory, which may be on a wrong path.
+ * Once every older instruction has left the pipeline without redirecting
+ * it the program has run off its code, and the run stops as the functional
+ * interpreter does. Returns APEX_SIM_FAULT then, and 0 otherwise.
+ */
+static APEX_NOINLINE int
+APEX_fetch_fault(APEX_CPU *cpu)
+{
+    int fu;
+
+    if (cpu->decode.has_insn || cpu->fetch_count || cpu->execute_count ||
+        cpu->writeback_count || cpu->itemCount || cpu->ooo.rob_count)
+    {
+        return 0;
+    }
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        if (cpu->fu_busy[fu])
+        {
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "APEX_Error: pc(%d) is outside code memory\n", cpu->pc);
+    return APEX_SIM_FAULT;
+}
+
+/* Whether fetch is enabled but stuck at a pc outside code memory */
+static inline int
+APEX_fetch_outside_code(const APEX_CPU *cpu)
+{
+    int index = get_code_memory_index_from_pc(cpu->pc);
+
+    return cpu->fetch.has_insn && (index < 0 || index >= cpu->code_memory_size);
+}
+
+/*
+ * One cycle of the out-of-order core, stages in reverse order like
+ * APEX_cycle. Kept out of line so that the in-order cycle stays as it was.
+ */
+static APEX_NOINLINE int
+APEX_ooo_cycle(APEX_CPU *cpu, const int observed)
+{
+    int status = APEX_ooo_commit(cpu, observed);
+
+    if (status)
+    {
+        return status;
+    }
+
+    APEX_ooo_execute(cpu, observed);
+    APEX_ooo_issue(cpu);
+    APEX_ooo_rename(cpu, observed);
+    APEX_fetch(cpu, observed);
+
+    cpu->ooo.rob_occupancy += cpu->ooo.rob_count;
+    cpu->ooo.iq_occupancy += cpu->ooo.iq_count;
+    return APEX_fetch_outside_code(cpu) ? APEX_fetch_fault(cpu) : 0;
+}
+
+/*
+ * Empties every pipeline latch, functional unit and the writeback queue and
+ * marks all registers and the zero flag as not pending, so that the next
+ * cycle starts fetching at cpu->pc. Architectural state (register values,
+ * zero flag, data memory, pc) is left untouched.
+ */
+void
+APEX_cpu_reset_pipeline(APEX_CPU *cpu)
+{
+    int i;
+
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(cpu->fetch_queue, 0, sizeof(cpu->fetch_queue));
+    memset(&cpu->decode, 0, sizeof(CPU_Stage));
+    memset(cpu->execute, 0, sizeof(cpu->execute));
+    cpu->execute_count = 0;
+    memset(cpu->fu, 0, sizeof(cpu->fu));
+    memset(cpu->writeback, 0, sizeof(cpu->writeback));
+    cpu->writeback_count = 0;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        cpu->reg[i].valid = 0;
+    }
+    cpu->zero_flag_valid = 0;
+
+    cpu->fetch_from_next_cycle = FALSE;
+    cpu->is_waiting_decode = 0;
+    cpu->fetch_head = 0;
+    cpu->fetch_count = 0;
+    cpu->fetch_stall = 0;
+    cpu->fetch_line = -1;
+    cpu->insn_fetched = 0;
+    cpu->fetch_icache_cycles = 0;
+    cpu->fetch_blocked_cycles = 0;
+    cpu->lsq_loads = 0;
+    cpu->lsq_stores = 0;
+    cpu->lsq_conflicts = 0;
+    cpu->lsq_forwarded = 0;
+    cpu->lsq_full_cycles = 0;
+    memset(cpu->issue_cycles, 0, sizeof(cpu->issue_cycles));
+    memset(cpu->fu_busy, 0, sizeof(cpu->fu_busy));
+    cpu->is_waiting_fu = 0;
+
+    /* Functional unit counters and statistics, writeback arbitration queue */
+    for (i = 0; i < NUM_FU_CLASSES * MAX_FU_SLOTS; ++i)
+    {
+        cpu->fu_counter[i / MAX_FU_SLOTS][i % MAX_FU_SLOTS] = 1;
+    }
+    memset(cpu->fu_ops, 0, sizeof(cpu->fu_ops));
+    memset(cpu->fu_occupancy, 0, sizeof(cpu->fu_occupancy));
+    memset(cpu->operands, 0, sizeof(cpu->operands));
+    cpu->operand_stall_cycles = 0;
+    APEX_bpred_reset_stats(&cpu->bpred);
+    APEX_cache_reset_stats(&cpu->dcache);
+    APEX_cache_reset_stats(&cpu->icache);
+    APEX_prefetch_reset_stats(&cpu->prefetch);
+    APEX_memory_reset(&cpu->memory);
+    cpu->rear = -1;
+    cpu->front = 0;
+    cpu->itemCount = 0;
+    APEX_ooo_reset(cpu);
+
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+}
+
+/*
+ * Runs the first numInsns instructions functionally and then switches to the
+ * cycle accurate pipeline, which continues from the resulting pc, registers,
+ * zero flag and data memory. The clock and retired instruction count start
+ * over for the detailed region; the skipped instructions are kept in
+ * insn_fast_forwarded.
+ *
+ * Returns the status of the functional run: APEX_SIM_INSN_LIMIT when the
+ * pipeline is ready to continue, APEX_SIM_HALTED or APEX_SIM_FAULT otherwise.
+ */
+int
+APEX_cpu_fast_forward(APEX_CPU *cpu, int numInsns)
+{
+    int status = APEX_SIM_INSN_LIMIT;
+
+    if (numInsns > 0)
+    {
+        status = APEX_functional_run(cpu, numInsns);
+    }
+
+    cpu->insn_fast_forwarded += cpu->insn_completed;
+
+    if (status == APEX_SIM_INSN_LIMIT)
+    {
+        cpu->insn_completed = 0;
+        cpu->clock = 1;
+        APEX_cpu_reset_pipeline(cpu);
+    }
+
+    return status;
+}
+
+/*
+ * Creates an independent copy of the CPU that shares the (read-only) code
+ * memory. Observers are not copied. Free it with APEX_cpu_stop.
+ */
+APEX_CPU *
+APEX_cpu_clone(const APEX_CPU *cpu)
+{
+    APEX_CPU *copy = malloc(sizeof(APEX_CPU));
+
+    if (!copy)
+    {
+        return NULL;
+    }
+
+    memcpy(copy, cpu, sizeof(APEX_CPU));
+    copy->owns_code_memory = FALSE;
+    copy->num_observers = 0;
+    copy->stop_requested = FALSE;
+    return copy;
+}
+
+/*
+ * This function creates and initializes APEX cpu around an already parsed
+ * code memory. The code memory is only read by the CPU, so a single copy can
+ * be shared by any number of CPUs; it is not freed by APEX_cpu_stop.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size, int printMsg)
+{
+    int i;
+    APEX_CPU *cpu;
+    APEX_Config config;
+
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    cpu = calloc(1, sizeof(APEX_CPU));
+
+    if (!cpu)
+    {
+        return NULL;
+    }
+
+    /* Initialize PC, Registers and all pipeline stages */
+    cpu->pc = 4000;
+    cpu->clock = 1;
+    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
+    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
+    cpu->single_step = ENABLE_SINGLE_STEP;
+
+    cpu->code_memory = code_memory;
+    cpu->code_memory_size = code_memory_size;
+    cpu->owns_code_memory = FALSE;
+
+    cpu->zero_flag_valid = 0;
+    if (printMsg == 1)
+    {
+        fprintf(stderr,
+                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
+                cpu->code_memory_size);
+        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
+        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+        printf("%-9s\t %-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2", "rs3",
+               "imm");
+
+        for (i = 0; i < cpu->code_memory_size; ++i)
+        {
+            printf("%-9s\t %-9d %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].info->mnemonic,
+                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
+                   cpu->code_memory[i].rs2, cpu->code_memory[i].rs3, cpu->code_memory[i].imm);
+        }
+    }
+
+    /* Default configuration, empty pipeline, fetch starts at pc */
+    APEX_config_default(&config);
+    APEX_cpu_configure(cpu, &config);
+    return cpu;
+}
+
+/*
+ * Replaces the configuration, empties the pipeline and starts the branch
+ * predictor, the caches and main memory afresh. Call it before the simulation starts
+ * or between runs.
+ *
+ * Returns FALSE if a count or latency is out of range or APEX_config_check
+ * rejects the configuration.
+ */
+int
+APEX_cpu_configure(APEX_CPU *cpu, const APEX_Config *config)
+{
+    int fu;
+
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        if (config->fu_count[fu] < 1 || config->fu_count[fu] > MAX_FU_INSTANCES ||
+            config->fu_latency[fu] < 1 || config->fu_latency[fu] > MAX_FU_LATENCY)
+        {
+            return FALSE;
+        }
+    }
+
+    if (!APEX_config_check(config))
+    {
+        return FALSE;
+    }
+
+    cpu->config = *config;
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        cpu->fu_depth[fu] = config->fu_pipelined[fu] ? config->fu_latency[fu] : 1;
+        cpu->fu_slots[fu] = config->fu_count[fu] * cpu->fu_depth[fu];
+    }
+    if (config->lsq_size)
+    {
+        /* The queue entries take the place of the load/store FU slots */
+        cpu->fu_depth[FU_LS] = cpu->fu_slots[FU_LS] = config->lsq_size;
+    }
+    APEX_bpred_init(&cpu->bpred, config);
+    APEX_cache_init(&cpu->dcache, &config->dcache);
+    APEX_cache_init(&cpu->icache, &config->icache);
+    APEX_memory_init(&cpu->memory, config);
+    APEX_prefetch_init(&cpu->prefetch, config);
+    cpu->fetch_buffered = config->icache.enabled || config->fetch_buffer > 0 ||
+                          config->fetch_width > 1;
+    APEX_cpu_reset_pipeline(cpu);
+    return TRUE;
+}
+
+/*
+ * This function parses the input file and creates an APEX cpu which owns the
+ * resulting code memory.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+APEX_CPU *
+APEX_cpu_init(const char *filename, int printMsg)
+{
+    APEX_CPU *cpu;
+    APEX_Instruction *code_memory;
+    int code_memory_size = 0;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    /* Parse input file and create code memory */
+    code_memory = create_code_memory(filename, &code_memory_size);
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    cpu = APEX_cpu_create(code_memory, code_memory_size, printMsg);
+    if (!cpu)
+    {
+        free(code_memory);
+        return NULL;
+    }
+
+    cpu->owns_code_memory = TRUE;
+    return cpu;
+}
+
+/*
+ * Registers an observer on the simulation loop. The observer must stay valid
+ * until it is removed or the CPU is stopped.
+ *
+ * Returns FALSE if MAX_OBSERVERS are already registered.
+ */
+int
+APEX_cpu_add_observer(APEX_CPU *cpu, const APEX_Observer *observer)
+{
+    if (cpu->num_observers == MAX_OBSERVERS)
+    {
+        return FALSE;
+    }
+
+    cpu->observers[cpu->num_observers++] = observer;
+    return TRUE;
+}
 
-    }else{
-        if (printMsg == 1)
+void
+APEX_cpu_remove_observer(APEX_CPU *cpu, const APEX_Observer *observer)
+{
+    int i;
+
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i] == observer)
         {
-           print_empty_content("Writeback", &cpu->writeback);
+            memmove(&cpu->observers[i], &cpu->observers[i + 1],
+                    (cpu->num_observers - i - 1) * sizeof(cpu->observers[0]));
+            cpu->num_observers--;
+            return;
         }
     }
-    
-
-    /* Default */
-    return 0;
 }
 
 /*
- * This function creates and initializes APEX cpu.
+ * One clock cycle of the pipeline. Stages run in reverse order so that each
+ * latch is consumed before it is refilled.
  *
- * Note: You are free to edit this function according to your implementation
+ * Returns APEX_SIM_HALTED once HALT has retired, in which case the remaining
+ * stages are not evaluated, APEX_SIM_FAULT when the program stops on a bad
+ * address or runs off its code, and 0 otherwise.
  */
-APEX_CPU *
-APEX_cpu_init(const char *filename, int printMsg)
+static inline int
+APEX_cycle(APEX_CPU *cpu, const int observed)
 {
-    int i;
-    APEX_CPU *cpu;
-    mulFUCounter = 1;
-    loadStoreFUCounter = 1;
-    integerFUCounter = 1;
+    int status;
 
-    if (!filename)
+    if (cpu->config.ooo)
     {
-        return NULL;
+        return APEX_ooo_cycle(cpu, observed);
     }
 
-    cpu = calloc(1, sizeof(APEX_CPU));
-
-    if (!cpu)
+    status = APEX_writeback(cpu, observed);
+    if (status)
     {
-        return NULL;
+        return status;
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    cpu->clock = 1;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+    APEX_execute(cpu, observed);
+    APEX_decode(cpu, observed);
+    APEX_fetch(cpu, observed);
+    return APEX_fetch_outside_code(cpu) ? APEX_fetch_fault(cpu) : 0;
+}
 
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+/* The two specializations of a cycle: flattening folds the constant
+ * `observed` into every stage, so the fast one has no observer checks left */
+static APEX_FLATTEN int
+APEX_cycle_fast(APEX_CPU *cpu)
+{
+    return APEX_cycle(cpu, FALSE);
+}
+
+/* Also returns APEX_SIM_STOP_REQUESTED when an observer asked to stop */
+static APEX_FLATTEN int
+APEX_cycle_observed(APEX_CPU *cpu)
+{
+    int status;
+    int i;
+
+    for (i = 0; i < cpu->num_observers; ++i)
     {
-        free(cpu);
-        return NULL;
+        if (cpu->observers[i]->cycle_begin)
+        {
+            cpu->observers[i]->cycle_begin(cpu, cpu->observers[i]->ctx);
+        }
     }
 
-    cpu->zero_flag_valid = 0;
-    if (printMsg == 1)
+    status = APEX_cycle(cpu, TRUE);
+    if (status)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s\t %-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2", "rs3",
-               "imm");
+        return status;
+    }
 
-        for (i = 0; i < cpu->code_memory_size; ++i)
+    for (i = 0; i < cpu->num_observers; ++i)
+    {
+        if (cpu->observers[i]->cycle_end)
         {
-            printf("%-9s\t %-9d %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].rs3, cpu->code_memory[i].imm);
+            cpu->observers[i]->cycle_end(cpu, cpu->observers[i]->ctx);
         }
     }
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
+    if (cpu->stop_requested)
+    {
+        cpu->stop_requested = FALSE;
+        return APEX_SIM_STOP_REQUESTED;
+    }
+
+    return 0;
 }
 
 /*
  * APEX CPU simulation loop
  *
- * Note: You are free to edit this function according to your implementation
+ * Runs until HALT retires, until the clock reaches totalCycles (0 means no
+ * limit), until an observer sets stop_requested or, in single step mode,
+ * until the user quits. Prints nothing by itself apart from the single step
+ * prompt; attach observers for output.
+ *
+ * Returns APEX_SIM_HALTED, APEX_SIM_CYCLE_LIMIT, APEX_SIM_STOP_REQUESTED,
+ * APEX_SIM_USER_QUIT or APEX_SIM_FAULT.
  */
-void
-APEX_cpu_run(APEX_CPU *cpu, int totalCycles)
+int
+APEX_cpu_loop(APEX_CPU *cpu, int totalCycles)
 {
     char user_prompt_val;
+    int status;
 
     while (TRUE)
     {
-        if (ENABLE_DEBUG_MESSAGES)
+        status = cpu->num_observers == 0 ? APEX_cycle_fast(cpu) : APEX_cycle_observed(cpu);
+        if (status == APEX_SIM_HALTED || status == APEX_SIM_FAULT)
         {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
+            return status;
         }
 
-        if (APEX_writeback(cpu, 1))
+        cpu->clock++;
+
+        if (status == APEX_SIM_STOP_REQUESTED)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
+            return status;
         }
 
-        //APEX_memory(cpu);
-        APEX_execute(cpu, 1);
-        APEX_decode(cpu, 1);
-        APEX_fetch(cpu, 1); 
-
-        print_reg_file(cpu);
-
-        /*printf("--------------------------------------------\n");
-        printf("Z Flag : %d\n", cpu->zero_flag);
-        printf("--------------------------------------------\n");*/
-
-        //printing data in memory location 20
-        /*printf("--------------------------------------------\n");
-        printf("Memory : %d\n", cpu->data_memory[20]);
-        printf("--------------------------------------------\n");*/
-
-        cpu->clock++;
-
         if (cpu->single_step)
         {
             printf("Press any key to advance CPU Clock or <q> to quit:\n");
@@ -1188,222 +2357,360 @@ APEX_cpu_run(APEX_CPU *cpu, int totalCycles)
 
             if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
             {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
+                return APEX_SIM_USER_QUIT;
             }
         }else{
             if(cpu->clock == totalCycles){
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                exit(1);
+                return APEX_SIM_CYCLE_LIMIT;
             }
         }
-
-        //cpu->clock++;
     }
 }
 
-void
-APEX_cpu_simulate(APEX_CPU *cpu, int totalCycles)
+/* Observer callbacks used by the interactive commands */
+static void
+trace_cycle_begin(APEX_CPU *cpu, void *ctx)
 {
-    char user_prompt_val;
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("--------------------------------------------\n");
+        printf("Clock Cycle #: %d\n", cpu->clock);
+        printf("--------------------------------------------\n");
+    }
+}
 
-    while (TRUE)
+static void
+trace_stage(APEX_CPU *cpu, const char *name, const CPU_Stage *stage, int has_insn, void *ctx)
+{
+    if (has_insn)
     {
-        /*if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }*/
+        print_stage_content(name, stage);
+    }
+    else
+    {
+        print_empty_content(name, stage);
+    }
+}
 
-        if (APEX_writeback(cpu, 0))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
-        }
+static void
+trace_reg_file(APEX_CPU *cpu, void *ctx)
+{
+    print_reg_file(cpu);
+}
 
-        APEX_execute(cpu, 0);
-        APEX_decode(cpu, 0);
-        APEX_fetch(cpu, 0);
+static void
+trace_zero_flag(APEX_CPU *cpu, void *ctx)
+{
+    printf("--------------------------------------------\n");
+    printf("Z Flag : %d\n", cpu->zero_flag);
+    printf("--------------------------------------------\n");
+}
 
-        //print_reg_file(cpu);
+static const APEX_Observer run_observer = {
+    .cycle_begin = trace_cycle_begin,
+    .stage = trace_stage,
+    .cycle_end = trace_reg_file,
+};
 
-        cpu->clock++;
+static const APEX_Observer display_observer = {
+    .cycle_begin = trace_cycle_begin,
+    .stage = trace_stage,
+    .cycle_end = trace_zero_flag,
+};
 
-        if (cpu->single_step)
-        {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
+/* Runs the loop with an optional observer and reports why it stopped */
+static int
+run_with_observer(APEX_CPU *cpu, int totalCycles, const APEX_Observer *observer)
+{
+    int status;
 
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
-        }else{
-            if(cpu->clock == totalCycles){
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                return;
-            }
-        }
+    if (observer)
+    {
+        APEX_cpu_add_observer(cpu, observer);
+    }
+
+    status = APEX_cpu_loop(cpu, totalCycles);
+
+    if (observer)
+    {
+        APEX_cpu_remove_observer(cpu, observer);
     }
+
+    if (status == APEX_SIM_HALTED)
+    {
+        /* Halt in writeback stage */
+        printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+    else
+    {
+        printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+    }
+
+    return status;
+}
+
+/* Prints every stage and the register file each cycle */
+void
+APEX_cpu_run(APEX_CPU *cpu, int totalCycles)
+{
+    run_with_observer(cpu, totalCycles, &run_observer);
+}
+
+/* Prints only the final summary */
+void
+APEX_cpu_simulate(APEX_CPU *cpu, int totalCycles)
+{
+    run_with_observer(cpu, totalCycles, NULL);
 }
 
+/* Prints every stage and the zero flag each cycle; with cpu->single_step
+ * set it also waits for a key after each one */
 void
 APEX_cpu_display(APEX_CPU *cpu, int totalCycles)
 {
-    char user_prompt_val;
+    run_with_observer(cpu, totalCycles, &display_observer);
+}
 
-    while (TRUE)
-    {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }
+/*
+ * Prints, for every functional unit, the instructions it completed, its
+ * throughput, the average number of instructions it held and its
+ * utilization: the share of its slots (one, or its latency if pipelined)
+ * that were busy over the cycles simulated. With lsq_size set the load/store
+ * queue takes the place of the load/store unit; its row gives the entries
+ * in use on average and their share of lsq_size.
+ */
+void
+APEX_cpu_print_fu_stats(APEX_CPU *cpu)
+{
+    int fu, i;
 
-        if (APEX_writeback(cpu, 1))
+    printf("================FUNCTIONAL UNIT OCCUPANCY==================\n");
+    printf("%-15s %-9s %12s %10s %10s %12s\n", "Unit", "Pipelined", "Ops", "Ops/cycle",
+           "In flight", "Utilization");
+
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        for (i = 0; i < cpu->config.fu_count[fu]; ++i)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
+            int lsq = fu == FU_LS && cpu->config.lsq_size;
+            double in_flight = (double)cpu->fu_occupancy[fu][i] / cpu->clock;
+
+            printf("%-15s %-9s %12lld %10.4f %10.4f %11.2f%%\n",
+                   lsq ? "LSQ entries" : fu_names[fu][i],
+                   lsq ? "-" : cpu->config.fu_pipelined[fu] ? "yes" : "no", cpu->fu_ops[fu][i],
+                   (double)cpu->fu_ops[fu][i] / cpu->clock, in_flight,
+                   100.0 * in_flight / cpu->fu_depth[fu]);
         }
+    }
+}
 
-        APEX_execute(cpu, 1);
-        APEX_decode(cpu, 1);
-        APEX_fetch(cpu, 1);
-
-        printf("--------------------------------------------\n");
-        printf("Z Flag : %d\n", cpu->zero_flag);
-        printf("--------------------------------------------\n");
+/*
+ * Prints where decode got the source operands of the instructions it
+ * issued, and the cycles it waited on a source that was not ready.
+ */
+void
+APEX_cpu_print_forwarding_stats(APEX_CPU *cpu)
+{
+    static const char *const forwarding_names[] = {
+        [FORWARD_NONE] = "off", [FORWARD_WRITEBACK] = "writeback", [FORWARD_ALL] = "all",
+    };
+    long long total = cpu->operands[OPERAND_REG_FILE] + cpu->operands[OPERAND_FROM_WRITEBACK] +
+                      cpu->operands[OPERAND_FROM_FU];
+    double percent = total ? 100.0 / total : 0.0;
+
+    printf("================OPERAND FORWARDING==================\n");
+    printf("Forwarding                  : %s\n", forwarding_names[cpu->config.forwarding]);
+    printf("Operands from register file : %12lld (%6.2f%%)\n", cpu->operands[OPERAND_REG_FILE],
+           percent * cpu->operands[OPERAND_REG_FILE]);
+    printf("Operands from writeback     : %12lld (%6.2f%%)\n",
+           cpu->operands[OPERAND_FROM_WRITEBACK], percent * cpu->operands[OPERAND_FROM_WRITEBACK]);
+    printf("Operands from FUs           : %12lld (%6.2f%%)\n", cpu->operands[OPERAND_FROM_FU],
+           percent * cpu->operands[OPERAND_FROM_FU]);
+    printf("Cycles stalled on operands  : %12lld\n", cpu->operand_stall_cycles);
+}
 
-        //print_reg_file(cpu);
+/*
+ * Prints the instructions fetched, wrong path included, and the cycles
+ * fetch waited for the instruction cache or for room in the fetch buffer
+ * (the decode latch without one).
+ */
+void
+APEX_cpu_print_fetch_stats(APEX_CPU *cpu)
+{
+    printf("================FETCH==================\n");
+    printf("Fetch width, buffer         : %d, %d\n", cpu->config.fetch_width,
+           cpu->config.fetch_buffer);
+    printf("Instructions fetched        : %12lld (%.2f per cycle)\n", cpu->insn_fetched,
+           cpu->clock > 1 ? (double)cpu->insn_fetched / (cpu->clock - 1) : 0.0);
+    printf("Cycles waiting on icache    : %12lld\n", cpu->fetch_icache_cycles);
+    printf("Cycles blocked by decode    : %12lld\n", cpu->fetch_blocked_cycles);
+}
 
-        cpu->clock++;
+/*
+ * Prints the issue width, the instructions retired per cycle and, with
+ * issue_width > 1, how many cycles decode issued each number of
+ * instructions.
+ */
+void
+APEX_cpu_print_issue_stats(APEX_CPU *cpu)
+{
+    int i;
 
-        if (cpu->single_step)
-        {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
+    printf("================ISSUE==================\n");
+    printf("Issue width                 : %d\n", cpu->config.issue_width);
+    printf("IPC                         : %12.4f\n",
+           cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0);
+    if (cpu->config.issue_width == 1)
+    {
+        return;
+    }
 
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
-        }else{
-            if(cpu->clock == totalCycles){
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                return;
-            }
-        }
+    for (i = 0; i <= cpu->config.issue_width; ++i)
+    {
+        printf("Cycles issuing %d            : %12lld (%6.2f%%)\n", i, cpu->issue_cycles[i],
+               cpu->clock ? 100.0 * cpu->issue_cycles[i] / cpu->clock : 0.0);
     }
 }
 
-void
-APEX_cpu_single_step(APEX_CPU *cpu, int totalCycles)
+/*
+ * Simulates totalCycles cycles (0 runs until HALT) of a copy of cpu for
+ * every issue width from 1 to MAX_ISSUE_WIDTH and prints the cycles, IPC
+ * and speedup over width 1 of each. Wider runs fetch at least issue_width
+ * instructions a cycle into a buffer of at least twice as many. Functional
+ * unit counts are kept, and a note names the classes they limit.
+ *
+ * Returns FALSE, after reporting why, with the out-of-order core or if a
+ * width cannot be configured.
+ */
+int
+APEX_cpu_width_sweep(APEX_CPU *cpu, int totalCycles)
 {
-    char user_prompt_val;
+    static const char *const fu_keys[NUM_FU_CLASSES] = {
+        [FU_INT] = "int", [FU_MUL] = "mul", [FU_LS] = "ls",
+    };
+    APEX_Config config = cpu->config;
+    int base_cycles = 0;
+    int width, fu, status;
+
+    if (cpu->config.ooo)
+    {
+        fprintf(stderr, "APEX_Error: issue widths are compared on the in-order core; "
+                "leave ooo 0\n");
+        return FALSE;
+    }
 
-    while (TRUE)
+    printf("================ISSUE WIDTH COMPARISON==================\n");
+    printf("%-6s %12s %12s %10s %10s\n", "Width", "Cycles", "Instructions", "IPC", "Speedup");
+    for (width = 1; width <= MAX_ISSUE_WIDTH; ++width)
     {
-        if (ENABLE_DEBUG_MESSAGES)
+        APEX_CPU *copy = APEX_cpu_clone(cpu);
+
+        if (!copy)
         {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            return FALSE;
         }
 
-        if (APEX_writeback(cpu, 1))
+        config.issue_width = width;
+        if (width > 1)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
+            config.fetch_width = width > cpu->config.fetch_width ? width : cpu->config.fetch_width;
+            config.fetch_buffer =
+                2 * width > cpu->config.fetch_buffer ? 2 * width : cpu->config.fetch_buffer;
+        }
+        if (!APEX_cpu_configure(copy, &config))
+        {
+            fprintf(stderr, "APEX_Error: issue_width=%d does not fit the configuration\n", width);
+            APEX_cpu_stop(copy);
+            return FALSE;
         }
 
-        APEX_execute(cpu, 1);
-        APEX_decode(cpu, 1);
-        APEX_fetch(cpu, 1);
-
-        printf("--------------------------------------------\n");
-        printf("Z Flag : %d\n", cpu->zero_flag);
-        printf("--------------------------------------------\n");
-
-        //print_reg_file(cpu);
-
-        cpu->clock++;
-
-        if (cpu->single_step)
+        status = APEX_cpu_loop(copy, totalCycles);
+        if (width == 1)
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
+            base_cycles = copy->clock;
+        }
+        printf("%-6d %12d %12d %10.4f %9.2fx%s\n", width, copy->clock, copy->insn_completed,
+               copy->clock ? (double)copy->insn_completed / copy->clock : 0.0,
+               copy->clock ? (double)base_cycles / copy->clock : 0.0,
+               status == APEX_SIM_HALTED ? "" : " (stopped)");
+        APEX_cpu_stop(copy);
+    }
 
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
-        }else{
-            if(cpu->clock == totalCycles){
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                return;
-            }
+    /* Each unit starts one instruction a cycle, so a class with fewer units
+     * than the group caps what a wider group gains */
+    for (fu = FU_INT; fu < NUM_FU_CLASSES; ++fu)
+    {
+        if (config.fu_count[fu] < MAX_ISSUE_WIDTH)
+        {
+            printf("Note: %s_fu_count=%d caps the %s instructions a group starts per cycle\n",
+                   fu_keys[fu], config.fu_count[fu], fu_keys[fu]);
         }
     }
+    return TRUE;
 }
 
+/*
+ * Prints the loads and stores the load/store queue took, its average
+ * occupancy, the cycles decode found it full, and the loads that matched an
+ * older store and how many of those were forwarded.
+ */
 void
-APEX_cpu_show_mem(APEX_CPU *cpu, int totalCycles)
+APEX_cpu_print_lsq_stats(APEX_CPU *cpu)
 {
-    char user_prompt_val;
+    double percent = cpu->lsq_loads ? 100.0 / cpu->lsq_loads : 0.0;
 
-    while (TRUE)
+    printf("================LOAD/STORE QUEUE==================\n");
+    if (!cpu->config.lsq_size)
     {
-        /*if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }*/
-
-        if (APEX_writeback(cpu, 0))
-        {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-            break;
-        }
-
-        APEX_execute(cpu, 0);
-        APEX_decode(cpu, 0);
-        APEX_fetch(cpu, 0);
-
-        /*printf("--------------------------------------------\n");
-        printf("Z Flag : %d\n", cpu->zero_flag);
-        printf("--------------------------------------------\n");*/
-
-        //print_reg_file(cpu);
+        printf("Size                        : off\n");
+        return;
+    }
 
-        cpu->clock++;
+    printf("Size, forwarding            : %d, %s\n", cpu->config.lsq_size,
+           cpu->config.lsq_forwarding ? "on" : "off");
+    printf("Loads                       : %12lld\n", cpu->lsq_loads);
+    printf("Stores                      : %12lld\n", cpu->lsq_stores);
+    printf("Average occupancy           : %12.2f\n",
+           cpu->clock ? (double)cpu->fu_occupancy[FU_LS][0] / cpu->clock : 0.0);
+    printf("Cycles full                 : %12lld\n", cpu->lsq_full_cycles);
+    printf("Loads matching a store      : %12lld (%6.2f%%)\n", cpu->lsq_conflicts,
+           percent * cpu->lsq_conflicts);
+    printf("Loads forwarded             : %12lld (%6.2f%%)\n", cpu->lsq_forwarded,
+           percent * cpu->lsq_forwarded);
+}
 
-        if (cpu->single_step)
-        {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
+/*
+ * Prints the sizes of the out-of-order core, the instructions it issued,
+ * the average occupancy of the ROB and issue queue, the cycles rename
+ * stalled because one of them or the free physical registers ran out, and
+ * the loads that took the data of an older store.
+ */
+void
+APEX_cpu_print_ooo_stats(APEX_CPU *cpu)
+{
+    const APEX_OoO *ooo = &cpu->ooo;
 
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
-        }else{
-            if(cpu->clock == totalCycles){
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                return;
-            }
-        }
+    printf("================OUT-OF-ORDER CORE==================\n");
+    if (!cpu->config.ooo)
+    {
+        printf("Core                        : in-order\n");
+        return;
     }
+
+    printf("ROB, IQ, physical registers : %d, %d, %d\n", cpu->config.rob_size,
+           cpu->config.iq_size, cpu->config.phys_regs);
+    printf("Rename and commit width     : %d\n", cpu->config.ooo_width);
+    printf("Instructions issued         : %12lld (%.2f per cycle)\n", ooo->issued,
+           cpu->clock ? (double)ooo->issued / cpu->clock : 0.0);
+    printf("Average ROB occupancy       : %12.2f\n",
+           cpu->clock ? (double)ooo->rob_occupancy / cpu->clock : 0.0);
+    printf("Average IQ occupancy        : %12.2f\n",
+           cpu->clock ? (double)ooo->iq_occupancy / cpu->clock : 0.0);
+    printf("Cycles ROB full             : %12lld\n", ooo->rob_full_cycles);
+    printf("Cycles IQ full              : %12lld\n", ooo->iq_full_cycles);
+    printf("Cycles out of registers     : %12lld\n", ooo->regs_full_cycles);
+    printf("Loads forwarded             : %12lld\n", ooo->loads_forwarded);
 }
 
 /*
@@ -1414,6 +2721,9 @@ APEX_cpu_show_mem(APEX_CPU *cpu, int totalCycles)
 void
 APEX_cpu_stop(APEX_CPU *cpu)
 {
-    free(cpu->code_memory);
+    if (cpu->owns_code_memory)
+    {
+        free(cpu->code_memory);
+    }
     free(cpu);
 }
\ No newline at end of file
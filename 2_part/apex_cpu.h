@@ -9,13 +9,29 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "apex_macros.h"
 
+/* Static facts about an opcode, see APEX_op_info */
+typedef struct APEX_OpInfo
+{
+    const char *mnemonic;
+    int fu;                        /* FU_INT, FU_MUL, FU_LS, or FU_NONE if not implemented */
+    int sources;                   /* SRC_RS1 | SRC_RS2 | SRC_RS3 registers read */
+    int writes_rd;                 /* Result is written to rd */
+    int sets_zero;                 /* Result sets the zero flag */
+    int reads_zero;                /* Waits for the zero flag (branches) */
+    int has_imm;                   /* Encoding has an immediate field */
+} APEX_OpInfo;
+
 /* Format of an APEX instruction  */
 typedef struct APEX_Instruction
 {
-    char opcode_str[128];
     int opcode;
+    uint32_t word;                 /* 32-bit encoding, see APEX_encode_word */
+    const APEX_OpInfo *info;       /* Filled in by APEX_predecode */
     int rd;
     int rs1;
     int rs2;
@@ -23,23 +39,24 @@ typedef struct APEX_Instruction
     int imm;
 } APEX_Instruction;
 
-/* Model of CPU stage latch */
+/*
+ * Model of CPU stage latch. The decoded fields (opcode, registers, imm) stay
+ * in code memory and the latch only points at them, so a stage hand-off
+ * copies the per-instruction values and nothing else.
+ */
 typedef struct CPU_Stage
 {
     int pc;
-    char opcode_str[128];
-    int opcode;
-    int rs1;
-    int rs2;
-    int rs3;
-    int rd;
-    int imm;
+    int has_insn;
+    const APEX_Instruction *insn;  /* Instruction in code memory */
     int rs1_value;
     int rs2_value;
     int rs3_value;
     int result_buffer;
     int memory_address;
-    int has_insn;
+    int predicted_taken;           /* Branches: fetch followed the taken path */
+    int bpred_ctx;                 /* Branches: predictor state to update with */
+    int latency;                   /* Cycles it spends in its functional unit */
 } CPU_Stage;
 
 
@@ -50,44 +67,453 @@ typedef struct REGISTER
     int regs;
 } REGISTER;
 
+typedef struct APEX_CPU APEX_CPU;
+
+/* Geometry and timing of a cache, see apex_cache.c. Sizes are in data
+ * memory words, or instructions for the instruction cache */
+typedef struct APEX_Cache_Config
+{
+    int enabled;
+    int size;
+    int line_size;
+    int assoc;                     /* Ways per set */
+    int replacement;               /* CACHE_LRU, CACHE_PLRU or CACHE_RANDOM */
+    int write_policy;              /* CACHE_WRITE_BACK or CACHE_WRITE_THROUGH */
+    int hit_latency;               /* Cycles of an access that hits */
+    int miss_latency;              /* Cycles a miss adds to fetch the line */
+} APEX_Cache_Config;
+
+/* Runtime configuration, see apex_config.c */
+typedef struct APEX_Config
+{
+    int fu_count[NUM_FU_CLASSES];  /* Functional units of each class */
+    int fu_latency[NUM_FU_CLASSES]; /* Cycles an instruction spends in a unit of each class */
+    int fu_pipelined[NUM_FU_CLASSES]; /* Units of the class start a new instruction every cycle */
+    int forwarding;                /* FORWARD_NONE, FORWARD_WRITEBACK or FORWARD_ALL */
+    int bpred;                     /* BPRED_ direction predictor */
+    int bpred_table_bits;          /* log2 entries of each predictor table */
+    int bpred_history_bits;        /* Global history length of gshare */
+    int btb_bits;                  /* log2 entries of the branch target buffer */
+    APEX_Cache_Config dcache;      /* L1 data cache of the load/store FUs */
+    APEX_Cache_Config icache;      /* L1 instruction cache of fetch */
+    int fetch_width;               /* Instructions fetched per cycle */
+    int fetch_buffer;              /* Fetched instructions waiting for decode, 0 for none */
+    int memory;                    /* MEMORY_ timing model of data memory */
+    int dram_banks;
+    int dram_row_size;             /* Words in a row of a bank */
+    int dram_trcd;                 /* Cycles to open a row */
+    int dram_tcas;                 /* Cycles from column access to data */
+    int dram_trp;                  /* Cycles to close (precharge) a row */
+    int dram_burst;                /* Cycles a transfer holds the data bus */
+    int dram_queue;                /* Requests the controller keeps outstanding */
+    int lsq_size;                  /* Load/store queue entries, 0 for plain load/store FUs */
+    int lsq_forwarding;            /* Loads take the data of a matching older store */
+    int lsq_forward_latency;       /* Cycles of a forwarded load */
+    int prefetch;                  /* PREFETCH_ data cache prefetcher */
+    int prefetch_table_bits;       /* log2 entries of the stride table */
+    int prefetch_degree;           /* Lines prefetched per trigger */
+    int prefetch_distance;         /* Lines, or strides, ahead of the access */
+    int ooo;                       /* Out-of-order core instead of the in-order one */
+    int rob_size;                  /* Reorder buffer entries */
+    int iq_size;                   /* Issue queue entries */
+    int phys_regs;                 /* Physical registers, the architectural ones included */
+    int ooo_width;                 /* Instructions renamed and committed per cycle */
+    int issue_width;               /* Instructions the in-order pipeline issues per cycle */
+} APEX_Config;
+
+typedef struct APEX_BTB_Entry
+{
+    int pc;                        /* Branch, or -1 if the entry is empty */
+    int target;
+} APEX_BTB_Entry;
+
+/*
+ * Branch predictor: a direction predictor, see apex_bpred.c, and a direct
+ * mapped branch target buffer. Held by value in the CPU so that a cloned CPU
+ * gets its own copy.
+ */
+typedef struct APEX_BPred
+{
+    int kind;                      /* BPRED_ predictor */
+    int table_mask;
+    int history_mask;
+    int history;                   /* Outcomes of the last resolved branches */
+    unsigned char bimodal[1 << MAX_BPRED_TABLE_BITS];
+    unsigned char gshare[1 << MAX_BPRED_TABLE_BITS];
+    unsigned char chooser[1 << MAX_BPRED_TABLE_BITS]; /* >= 2 picks gshare */
+    int btb_mask;
+    APEX_BTB_Entry btb[1 << MAX_BTB_BITS];
+
+    /* Since the pipeline was last reset */
+    long long branches;
+    long long mispredicts;
+    long long squashed;            /* Wrong path instructions flushed */
+    long long lost_cycles;         /* Cycles from a redirect until the right path issues */
+    int recovering;                /* Redirected, no right path instruction issued yet */
+    int redirect_clock;            /* Cycle of the last redirect */
+} APEX_BPred;
+
+typedef struct APEX_Cache_Line
+{
+    unsigned int tag;              /* Line address (address / line size) */
+    unsigned char valid;
+    unsigned char dirty;
+    unsigned char prefetched;      /* Filled by a prefetch, not accessed since */
+    unsigned int last_used;        /* LRU: access stamp */
+    long long ready;               /* Prefetched lines: cycle the fill completes */
+} APEX_Cache_Line;
+
+/*
+ * Set associative cache. Only tags are kept: data stays in data memory, so
+ * the cache decides how long an access takes and nothing else. Held by value
+ * in the CPU so that a cloned CPU gets its own copy.
+ */
+typedef struct APEX_Cache
+{
+    APEX_Cache_Config config;
+    int line_bits;                 /* log2 line_size */
+    int set_mask;
+    unsigned int stamp;            /* LRU: stamp of the next access */
+    unsigned int random;           /* Random replacement: xorshift state */
+    APEX_Cache_Line lines[MAX_CACHE_LINES]; /* assoc consecutive lines per set */
+    unsigned int plru[MAX_CACHE_LINES]; /* PLRU: tree bits of each set */
+    int trigger;                   /* Last access missed or hit a prefetched line */
+
+    /* Since the pipeline was last reset */
+    long long reads;
+    long long read_misses;
+    long long writes;
+    long long write_misses;
+    long long writebacks;          /* Dirty lines written back on eviction */
+    long long memory_writes;       /* Write-through stores sent to memory */
+    long long prefetches;          /* Lines filled by APEX_cache_prefetch */
+    long long prefetch_hits;       /* Accesses to a prefetched line, first only */
+    long long prefetch_late;       /* Of those, before its fill completed */
+    long long prefetch_late_cycles; /* Cycles they waited for the fill */
+    long long prefetch_unused;     /* Prefetched lines evicted without an access */
+} APEX_Cache;
+
+typedef struct APEX_Prefetch_Entry
+{
+    int pc;                        /* Load or store, or -1 if the entry is empty */
+    int address;                   /* Its last address */
+    int stride;
+    int confidence;                /* 0 .. 3, prefetches from 2 */
+} APEX_Prefetch_Entry;
+
+/*
+ * Data cache prefetcher, see apex_prefetch.c. Held by value in the CPU so
+ * that a cloned CPU gets its own copy.
+ */
+typedef struct APEX_Prefetcher
+{
+    int kind;                      /* PREFETCH_ prefetcher */
+    int table_mask;
+    int degree;
+    int distance;
+    APEX_Prefetch_Entry table[1 << MAX_PREFETCH_TABLE_BITS];
+
+    /* Since the pipeline was last reset */
+    long long triggers;            /* Accesses that made prefetches */
+    long long requests;            /* Lines asked for, filled or not */
+    long long redundant;           /* Lines asked for that were already cached */
+} APEX_Prefetcher;
+
+typedef struct APEX_DRAM_Bank
+{
+    int open_row;                  /* Row in the row buffer, or -1 if closed */
+    long long busy_until;          /* Cycle the bank takes the next command */
+} APEX_DRAM_Bank;
+
+/*
+ * Main memory timing, see apex_memory.c. Like the caches it only decides
+ * how long an access takes; data stays in data memory. Held by value in
+ * the CPU so that a cloned CPU gets its own copy.
+ */
+typedef struct APEX_Memory
+{
+    int model;                     /* MEMORY_ timing model */
+    APEX_DRAM_Bank banks[MAX_DRAM_BANKS];
+    long long bus_free;            /* Cycle the data bus is free */
+    long long pending[MAX_DRAM_QUEUE]; /* Completion cycle of each outstanding request */
+    int num_pending;
+    int banks_count;
+    int row_size;
+    int trcd;
+    int tcas;
+    int trp;
+    int burst;
+    int queue;
+
+    /* Since the pipeline was last reset */
+    long long reads;
+    long long writes;
+    long long row_hits;            /* Row already open */
+    long long row_misses;          /* Bank closed, row opened */
+    long long row_conflicts;       /* Other row open, closed first */
+    long long latency;             /* Cycles of all accesses */
+    long long queue_cycles;        /* Cycles requests waited for a queue entry */
+    long long bank_cycles;         /* Cycles requests waited for a busy bank */
+} APEX_Memory;
+
+/* Instruction in the reorder buffer of the out-of-order core */
+typedef struct APEX_ROB_Entry
+{
+    CPU_Stage stage;               /* Operands and, once executed, result and address */
+    long long seq;                 /* Program order */
+    int dest;                      /* Physical register of the result, or -1 */
+    int src[3];                    /* Physical registers of rs1, rs2 and rs3, or -1 */
+    int zero_src;                  /* Branches: physical register of the zero flag */
+    int executed;                  /* Result, or store address and data, computed */
+    int completed;                 /* Spent its latency, may commit */
+    int rat[NUM_ARCH_REGS];        /* Branches: rename table to recover on a mispredict */
+} APEX_ROB_Entry;
+
+/*
+ * Out-of-order core, see APEX_ooo_cycle. An instruction that writes rd or
+ * the zero flag gets a physical register for its result; both names may
+ * map to it, the zero flag being set when it is zero.
+ */
+typedef struct APEX_OoO
+{
+    int rat[NUM_ARCH_REGS];        /* Rename table: physical register of each name */
+    int commit_rat[NUM_ARCH_REGS]; /* The same for committed instructions */
+    int prf_value[MAX_PHYS_REGS];
+    unsigned char prf_ready[MAX_PHYS_REGS];
+    int prf_refs[MAX_PHYS_REGS];   /* Names mapping to it in commit_rat */
+    int free_list[MAX_PHYS_REGS];
+    int free_count;
+    APEX_ROB_Entry rob[MAX_ROB_SIZE];
+    int rob_head;
+    int rob_count;
+    long long seq;                 /* Program order of the next instruction renamed */
+    int iq[MAX_IQ_SIZE];           /* Reorder buffer entries waiting to issue, oldest first */
+    int iq_count;
+    int fu_rob[NUM_FU_CLASSES][MAX_FU_SLOTS]; /* Reorder buffer entry of each FU slot */
+
+    /* Since the pipeline was last reset */
+    long long issued;
+    long long rob_occupancy;       /* Sum over cycles of the entries in use */
+    long long iq_occupancy;
+    long long rob_full_cycles;     /* Cycles rename stalled on each resource */
+    long long iq_full_cycles;
+    long long regs_full_cycles;
+    long long loads_forwarded;     /* Loads that took the data of an older store */
+} APEX_OoO;
+
+/* Result of a sampled simulation */
+typedef struct APEX_Sample_Stats
+{
+    int samples;                   /* Detailed windows measured */
+    int windows_dropped;           /* Windows cut short by HALT or a stall */
+    int instructions;              /* Instructions in the whole run */
+    double cpi_mean;
+    double cpi_stddev;
+    double cpi_ci95;               /* Half width of the 95% confidence interval */
+    double est_cycles;             /* cpi_mean * instructions */
+} APEX_Sample_Stats;
+
+/*
+ * Hooks into the simulation loop. Any callback may be NULL and ctx is passed
+ * back unchanged. Runs without observers take a path with no hook checks.
+ */
+typedef struct APEX_Observer
+{
+    /* Start and end of every cycle; cycle_end is skipped on the HALT cycle */
+    void (*cycle_begin)(APEX_CPU *cpu, void *ctx);
+    void (*cycle_end)(APEX_CPU *cpu, void *ctx);
+
+    /* After each stage has run, with the latch it worked on */
+    void (*stage)(APEX_CPU *cpu, const char *name, const CPU_Stage *stage,
+                  int has_insn, void *ctx);
+
+    /* An instruction left the writeback stage */
+    void (*retire)(APEX_CPU *cpu, const CPU_Stage *stage, void *ctx);
+
+    /* Decode held an instruction back because its operands were not ready */
+    void (*stall)(APEX_CPU *cpu, const CPU_Stage *stage, void *ctx);
+
+    /* A branch resolved in the integer FU, before the predictor is trained */
+    void (*branch)(APEX_CPU *cpu, const CPU_Stage *stage, int taken, void *ctx);
+
+    /* A load or store accessed data memory at stage->memory_address */
+    void (*memory)(APEX_CPU *cpu, const CPU_Stage *stage, void *ctx);
+
+    void *ctx;
+} APEX_Observer;
+
 /* Model of APEX CPU */
-typedef struct APEX_CPU
+struct APEX_CPU
 {
     int pc;                        /* Current program counter */
     int clock;                     /* Clock cycles elapsed */
     int insn_completed;            /* Instructions retired */
+    int insn_fast_forwarded;       /* Instructions executed functionally before the pipeline took over */
     int regs[REG_FILE_SIZE];      /* Integer register file */
     int code_memory_size;          /* Number of instruction in the input file */
     APEX_Instruction *code_memory; /* Code Memory */
+    int owns_code_memory;          /* Free code memory in APEX_cpu_stop */
     int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
     int single_step;               /* Wait for user input after every cycle */
     int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
-    int zero_flag_valid;
+    int zero_flag_valid;           /* In-flight instructions that set the zero flag */
     int fetch_from_next_cycle;
     REGISTER reg[REG_FILE_SIZE];                   /*register file structure*/
     int is_waiting_decode;
-    int is_waiting_intFU;
-    int is_waiting_mulFU;
-    int is_waiting_loadFU;
+    int fu_busy[NUM_FU_CLASSES];   /* Functional units holding an instruction, by FU class */
     int is_waiting_fu;
+    APEX_Config config;            /* Set with APEX_cpu_configure */
+
+    /*
+     * Each unit owns fu_depth consecutive slots of its class in fu[] (its
+     * latency if pipelined, else 1), one per instruction in flight; a class
+     * has fu_slots slots in all.
+     */
+    int fu_depth[NUM_FU_CLASSES];
+    int fu_slots[NUM_FU_CLASSES];
+
+    /* Functional unit cycle counters, by FU class and slot */
+    int fu_counter[NUM_FU_CLASSES][MAX_FU_SLOTS];
+
+    /* Per unit instructions completed and cycles spent in the unit by them,
+     * since the pipeline was last reset */
+    long long fu_ops[NUM_FU_CLASSES][MAX_FU_INSTANCES];
+    long long fu_occupancy[NUM_FU_CLASSES][MAX_FU_INSTANCES];
+
+    /* Source operands issued, by where decode got them (an OPERAND_ value),
+     * and cycles decode held an instruction for a source that was not
+     * ready, since the pipeline was last reset */
+    long long operands[NUM_OPERAND_SOURCES];
+    long long operand_stall_cycles;
+
+    APEX_BPred bpred;              /* Set up by APEX_cpu_configure */
+    APEX_Cache dcache;             /* Set up by APEX_cpu_configure */
+    APEX_Cache icache;             /* Set up by APEX_cpu_configure */
+    APEX_Memory memory;            /* Set up by APEX_cpu_configure */
+    APEX_Prefetcher prefetch;      /* Set up by APEX_cpu_configure */
+
+    /* Front end with a fetch buffer or instruction cache, see
+     * APEX_fetch_buffered */
+    int fetch_buffered;
+    int fetch_head;                /* Oldest entry of fetch_queue */
+    int fetch_count;
+    int fetch_stall;               /* Cycles fetch still waits for the instruction cache */
+    int fetch_line;                /* Instruction cache line being fetched from, or -1 */
+
+    /* Instructions fetched (wrong path included), cycles fetch waited for
+     * the instruction cache and cycles it had no room for another
+     * instruction, since the pipeline was last reset */
+    long long insn_fetched;
+    long long fetch_icache_cycles;
+    long long fetch_blocked_cycles;
+
+    /* Load/store queue: memory instructions issued, loads that found an
+     * older store to the same address in the queue and how many of those
+     * took its data, and cycles decode held a memory instruction because
+     * the queue was full, since the pipeline was last reset */
+    long long lsq_loads;
+    long long lsq_stores;
+    long long lsq_conflicts;
+    long long lsq_forwarded;
+    long long lsq_full_cycles;
+
+    /* Cycles in which decode issued 0 to issue_width instructions, since
+     * the pipeline was last reset; only counted with issue_width > 1 */
+    long long issue_cycles[MAX_ISSUE_WIDTH + 1];
+
+    /* Writeback arbitration queue */
+    int priorityQueue[MAX_QUEUE_SIZE];
+    int front;
+    int rear;
+    int itemCount;
+
+    /* Observers attached to the simulation loop */
+    const APEX_Observer *observers[MAX_OBSERVERS];
+    int num_observers;
+    int stop_requested;            /* Set by an observer to end APEX_cpu_loop after this cycle */
 
     /* Pipeline stages */
     CPU_Stage fetch;
     CPU_Stage decode;
-    CPU_Stage execute;
-    CPU_Stage integerFU;
-    CPU_Stage multiplierFU;
-    CPU_Stage loadStoreFU;
-    CPU_Stage writeback;
-} APEX_CPU;
+    CPU_Stage execute[MAX_ISSUE_WIDTH];   /* Issue group, in program order */
+    int execute_count;
+    CPU_Stage fu[NUM_FU_CLASSES][MAX_FU_SLOTS]; /* Functional unit slots, by FU class */
+    CPU_Stage writeback[MAX_ISSUE_WIDTH]; /* Completed instructions, in program order */
+    int writeback_count;
+    CPU_Stage fetch_queue[MAX_FETCH_BUFFER + 1]; /* Fetch buffer, and the entry decode takes */
+    APEX_OoO ooo;                  /* Out-of-order core, used if config.ooo is set */
+};
+
+extern const APEX_OpInfo APEX_op_info[NUM_OPCODES];
+extern const char *const APEX_bpred_names[NUM_BPREDS + 1];
+extern const char *const APEX_cache_replacement_names[NUM_CACHE_POLICIES + 1];
+extern const char *const APEX_cache_write_names[NUM_CACHE_WRITE_POLICIES + 1];
+extern const char *const APEX_memory_names[NUM_MEMORY_MODELS + 1];
+extern const char *const APEX_prefetch_names[NUM_PREFETCHERS + 1];
 
 APEX_Instruction *create_code_memory(const char *filename, int *size);
+int APEX_assemble(const char *source, const char *image);
+int APEX_image_check(const void *data, size_t length);
+APEX_Instruction *APEX_image_decode(const void *data, size_t length, const char *filename,
+                                    int *size);
+int APEX_image_write(const char *path, const APEX_Instruction *code_memory, int size,
+                     const void *text, size_t length);
+APEX_Instruction *APEX_image_cache_load(const void *text, size_t length, int *size);
+void APEX_image_cache_store(const void *text, size_t length, const APEX_Instruction *code_memory,
+                            int size);
+int APEX_opcode_lookup(const char *mnemonic, int len);
+int APEX_encode_word(const APEX_Instruction *ins, uint32_t *word);
+int APEX_decode_word(uint32_t word, APEX_Instruction *ins);
+int APEX_predecode(APEX_Instruction *code_memory, int code_memory_size);
 APEX_CPU *APEX_cpu_init(const char *filename, int printMsg);
+APEX_CPU *APEX_cpu_create(APEX_Instruction *code_memory, int code_memory_size, int printMsg);
+int APEX_cpu_configure(APEX_CPU *cpu, const APEX_Config *config);
+void APEX_config_default(APEX_Config *config);
+int APEX_config_set(APEX_Config *config, const char *setting);
+int APEX_config_load(APEX_Config *config, const char *filename);
+int APEX_config_check(const APEX_Config *config);
+void APEX_bpred_init(APEX_BPred *bp, const APEX_Config *config);
+void APEX_bpred_reset_stats(APEX_BPred *bp);
+int APEX_bpred_predict(const APEX_BPred *bp, int pc, int *target, int *ctx);
+void APEX_bpred_update(APEX_BPred *bp, int pc, int ctx, int taken, int target);
+void APEX_bpred_print_stats(const APEX_BPred *bp, int instructions);
+int APEX_bpred_sweep(APEX_CPU *cpu, int totalCycles, const char *names);
+int APEX_cache_config_check(const APEX_Cache_Config *config, const char *name);
+void APEX_cache_init(APEX_Cache *cache, const APEX_Cache_Config *config);
+void APEX_cache_reset_stats(APEX_Cache *cache);
+int APEX_cache_access(APEX_Cache *cache, APEX_Memory *memory, int address, int is_write,
+                      long long now);
+void APEX_cache_print_stats(const APEX_Cache *cache, const char *title);
+int APEX_cache_prefetch(APEX_Cache *cache, APEX_Memory *memory, int address, long long now);
+int APEX_cache_sweep(APEX_CPU *cpu, int totalCycles);
+void APEX_memory_init(APEX_Memory *memory, const APEX_Config *config);
+void APEX_memory_reset(APEX_Memory *memory);
+int APEX_memory_access(APEX_Memory *memory, int address, int is_write, long long now);
+void APEX_memory_print_stats(const APEX_Memory *memory);
+void APEX_prefetch_init(APEX_Prefetcher *pf, const APEX_Config *config);
+void APEX_prefetch_reset_stats(APEX_Prefetcher *pf);
+void APEX_prefetch_access(APEX_Prefetcher *pf, APEX_Cache *cache, APEX_Memory *memory, int pc,
+                          int address, long long now);
+void APEX_prefetch_print_stats(const APEX_Prefetcher *pf, const APEX_Cache *cache);
 void APEX_cpu_run(APEX_CPU *cpu, int totalCycles);
 void APEX_cpu_simulate(APEX_CPU *cpu, int totalCycles);
+APEX_CPU *APEX_cpu_clone(const APEX_CPU *cpu);
+void APEX_cpu_reset_pipeline(APEX_CPU *cpu);
+int APEX_cpu_fast_forward(APEX_CPU *cpu, int numInsns);
+int APEX_cpu_loop(APEX_CPU *cpu, int totalCycles);
+int APEX_cpu_add_observer(APEX_CPU *cpu, const APEX_Observer *observer);
+void APEX_cpu_remove_observer(APEX_CPU *cpu, const APEX_Observer *observer);
 void APEX_cpu_display(APEX_CPU *cpu, int totalCycles);
-void APEX_cpu_single_step(APEX_CPU *cpu, int totalCycles);
-void APEX_cpu_show_mem(APEX_CPU *cpu, int totalCycles);
 void print_reg_file(APEX_CPU *cpu);
+void APEX_cpu_print_fu_stats(APEX_CPU *cpu);
+void APEX_cpu_print_forwarding_stats(APEX_CPU *cpu);
+void APEX_cpu_print_fetch_stats(APEX_CPU *cpu);
+void APEX_cpu_print_lsq_stats(APEX_CPU *cpu);
+void APEX_cpu_print_ooo_stats(APEX_CPU *cpu);
+void APEX_cpu_print_issue_stats(APEX_CPU *cpu);
+int APEX_cpu_width_sweep(APEX_CPU *cpu, int totalCycles);
 void APEX_cpu_stop(APEX_CPU *cpu);
+int APEX_batch_run(const char *manifest, int num_threads, const APEX_Config *config);
+int APEX_functional_run(APEX_CPU *cpu, int maxInsns);
+int APEX_cpu_sample(APEX_CPU *cpu, int period, int warmup, int measure, APEX_Sample_Stats *stats);
 #endif
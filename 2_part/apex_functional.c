@@ -0,0 +1,225 @@
+/*
+ * apex_functional.c
+ * Functional (ISA-only) execution of APEX programs
+ *
+ * Executes code memory one instruction at a time with the same semantics as
+ * the integer, multiplier and load/store FUs plus writeback of the pipeline,
+ * but without latches, FU counters or the writeback queue. Only the
+ * architectural state is kept: register values, zero flag, data memory and
+ * PC. Use it when the final state matters and the timing does not.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/*
+ * Executes up to maxInsns instructions (0 means no limit) starting at
+ * cpu->pc. Register values, zero flag, data memory, pc and insn_completed
+ * of the CPU are updated; pipeline latches and clock are left untouched.
+ *
+ * Returns APEX_SIM_HALTED once HALT has executed (pc is left on the HALT),
+ * APEX_SIM_INSN_LIMIT when maxInsns instructions have executed, or
+ * APEX_SIM_FAULT when the program leaves code or data memory or uses an
+ * instruction the pipeline does not implement.
+ */
+int
+APEX_functional_run(APEX_CPU *cpu, int maxInsns)
+{
+    const APEX_Instruction *code = cpu->code_memory;
+    const int code_size = cpu->code_memory_size;
+    int *mem = cpu->data_memory;
+    int regs[REG_FILE_SIZE];
+    int zero_flag = cpu->zero_flag;
+    int index = (cpu->pc - 4000) / 4;
+    int executed = 0;
+    int status = APEX_SIM_INSN_LIMIT;
+    int address;
+    int i;
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        regs[i] = cpu->reg[i].regs;
+    }
+
+    while (maxInsns == 0 || executed < maxInsns)
+    {
+        const APEX_Instruction *ins;
+
+        if (index < 0 || index >= code_size)
+        {
+            fprintf(stderr, "APEX_Error: pc(%d) is outside code memory\n", 4000 + index * 4);
+            status = APEX_SIM_FAULT;
+            break;
+        }
+
+        ins = &code[index];
+
+        switch (ins->opcode)
+        {
+            case OPCODE_ADD:
+            {
+                regs[ins->rd] = regs[ins->rs1] + regs[ins->rs2];
+                zero_flag = (regs[ins->rd] == 0);
+                break;
+            }
+
+            case OPCODE_SUB:
+            {
+                regs[ins->rd] = regs[ins->rs1] - regs[ins->rs2];
+                zero_flag = (regs[ins->rd] == 0);
+                break;
+            }
+
+            case OPCODE_MUL:
+            {
+                regs[ins->rd] = regs[ins->rs1] * regs[ins->rs2];
+                zero_flag = (regs[ins->rd] == 0);
+                break;
+            }
+
+            case OPCODE_ADDL:
+            {
+                regs[ins->rd] = regs[ins->rs1] + ins->imm;
+                zero_flag = (regs[ins->rd] == 0);
+                break;
+            }
+
+            case OPCODE_SUBL:
+            {
+                regs[ins->rd] = regs[ins->rs1] - ins->imm;
+                zero_flag = (regs[ins->rd] == 0);
+                break;
+            }
+
+            case OPCODE_AND:
+            {
+                regs[ins->rd] = regs[ins->rs1] & regs[ins->rs2];
+                break;
+            }
+
+            case OPCODE_OR:
+            {
+                regs[ins->rd] = regs[ins->rs1] | regs[ins->rs2];
+                break;
+            }
+
+            case OPCODE_XOR:
+            {
+                regs[ins->rd] = regs[ins->rs1] ^ regs[ins->rs2];
+                break;
+            }
+
+            case OPCODE_MOVC:
+            {
+                regs[ins->rd] = ins->imm;
+                break;
+            }
+
+            case OPCODE_CMP:
+            {
+                zero_flag = (regs[ins->rs1] == regs[ins->rs2]);
+                break;
+            }
+
+            case OPCODE_LOAD:
+            case OPCODE_LDR:
+            {
+                address = regs[ins->rs1] +
+                          (ins->opcode == OPCODE_LOAD ? ins->imm : regs[ins->rs2]);
+                if (address < 0 || address >= DATA_MEMORY_SIZE)
+                {
+                    goto bad_address;
+                }
+                regs[ins->rd] = mem[address];
+                break;
+            }
+
+            case OPCODE_STORE:
+            {
+                address = regs[ins->rs2] + ins->imm;
+                if (address < 0 || address >= DATA_MEMORY_SIZE)
+                {
+                    goto bad_address;
+                }
+                mem[address] = regs[ins->rs1];
+                break;
+            }
+
+            case OPCODE_STR:
+            {
+                address = regs[ins->rs1] + regs[ins->rs2];
+                if (address < 0 || address >= DATA_MEMORY_SIZE)
+                {
+                    goto bad_address;
+                }
+                mem[address] = regs[ins->rs3];
+                break;
+            }
+
+            case OPCODE_BZ:
+            {
+                if (zero_flag)
+                {
+                    index = (index * 4 + ins->imm) / 4;
+                    executed++;
+                    continue;
+                }
+                break;
+            }
+
+            case OPCODE_BNZ:
+            {
+                if (!zero_flag)
+                {
+                    index = (index * 4 + ins->imm) / 4;
+                    executed++;
+                    continue;
+                }
+                break;
+            }
+
+            case OPCODE_NOP:
+            {
+                break;
+            }
+
+            case OPCODE_HALT:
+            {
+                executed++;
+                status = APEX_SIM_HALTED;
+                goto done;
+            }
+
+            default:
+            {
+                fprintf(stderr, "APEX_Error: pc(%d) %s is not supported\n",
+                        4000 + index * 4, ins->info->mnemonic);
+                status = APEX_SIM_FAULT;
+                goto done;
+            }
+        }
+
+        executed++;
+        index++;
+    }
+
+    goto done;
+
+bad_address:
+    fprintf(stderr, "APEX_Error: pc(%d) %s accesses MEM[%d] outside data memory\n",
+            4000 + index * 4, code[index].info->mnemonic, address);
+    status = APEX_SIM_FAULT;
+
+done:
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        cpu->reg[i].regs = regs[i];
+    }
+    cpu->zero_flag = zero_flag;
+    cpu->pc = 4000 + index * 4;
+    cpu->insn_completed += executed;
+    return status;
+}
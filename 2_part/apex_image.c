@@ -0,0 +1,289 @@
+/*
+ * apex_image.c
+ * Pre-assembled binary program images and the assembled program cache
+ *
+ * An image is a header followed by the 32-bit encoding (APEX_encode_word) of
+ * every instruction:
+ *
+ *     magic[8] version num_insns source_hash checksum
+ *     word * num_insns
+ *
+ * in host byte order. source_hash is the FNV-1a hash of the text the image
+ * was assembled from and checksum the FNV-1a hash of the words. Loading an
+ * image skips text parsing entirely.
+ *
+ * When the APEX_CACHE_DIR environment variable names a directory, every text
+ * program that is parsed is also stored there as <source_hash>.apeximg, and
+ * later loads of the same text (by content, not by name) use the image.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+#define APEX_IMAGE_MAGIC "APEXIMG"
+
+/* Environment variable naming the assembled program cache directory */
+#define APEX_CACHE_ENV "APEX_CACHE_DIR"
+
+typedef struct APEX_Image_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_insns;
+    uint64_t source_hash;
+    uint64_t checksum;
+} APEX_Image_Header;
+
+/* 64-bit FNV-1a */
+static uint64_t
+image_hash(const void *data, size_t length)
+{
+    const unsigned char *p = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+
+    for (i = 0; i < length; ++i)
+    {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/* Returns TRUE if data starts like an image, of any version */
+int
+APEX_image_check(const void *data, size_t length)
+{
+    const APEX_Image_Header *header = data;
+
+    return length >= sizeof(APEX_Image_Header) &&
+           memcmp(header->magic, APEX_IMAGE_MAGIC, sizeof(header->magic)) == 0;
+}
+
+/*
+ * Decodes an image held in memory into a new code memory. Returns NULL,
+ * after reporting why, if the image is truncated, fails its checksum or
+ * holds an invalid instruction word.
+ */
+APEX_Instruction *
+APEX_image_decode(const void *data, size_t length, const char *filename, int *size)
+{
+    const APEX_Image_Header *header = data;
+    const uint32_t *words;
+    APEX_Instruction *code_memory;
+    uint32_t i;
+
+    if (!APEX_image_check(data, length))
+    {
+        fprintf(stderr, "APEX_Error: %s: not a valid program image\n", filename);
+        return NULL;
+    }
+
+    if (header->version != APEX_IMAGE_VERSION)
+    {
+        fprintf(stderr, "APEX_Error: %s: program image version %u, expected %d; "
+                "assemble it again\n", filename, header->version, APEX_IMAGE_VERSION);
+        return NULL;
+    }
+
+    if (header->num_insns == 0 ||
+        length != sizeof(APEX_Image_Header) + header->num_insns * sizeof(uint32_t))
+    {
+        fprintf(stderr, "APEX_Error: %s: not a valid program image\n", filename);
+        return NULL;
+    }
+
+    words = (const uint32_t *)(header + 1);
+    if (image_hash(words, header->num_insns * sizeof(uint32_t)) != header->checksum)
+    {
+        fprintf(stderr, "APEX_Error: %s: program image checksum mismatch\n", filename);
+        return NULL;
+    }
+
+    code_memory = calloc(header->num_insns, sizeof(APEX_Instruction));
+    if (!code_memory)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < header->num_insns; ++i)
+    {
+        if (!APEX_decode_word(words[i], &code_memory[i]))
+        {
+            fprintf(stderr, "APEX_Error: %s: invalid instruction word 0x%08x at pc(%d)\n",
+                    filename, words[i], 4000 + i * 4);
+            free(code_memory);
+            return NULL;
+        }
+    }
+
+    *size = header->num_insns;
+    return code_memory;
+}
+
+/*
+ * Writes code memory as an image. The file is written under a temporary name
+ * and renamed into place, so readers never see a partial image.
+ *
+ * Returns TRUE on success.
+ */
+static int
+image_write(const char *path, const APEX_Instruction *code_memory, int size,
+            uint64_t source_hash)
+{
+    APEX_Image_Header header;
+    uint32_t *words;
+    char tmp_path[MAX_BATCH_PATH + 8];
+    FILE *fp;
+    int fd, i, ok;
+
+    words = malloc(size * sizeof(uint32_t));
+    if (!words)
+    {
+        return FALSE;
+    }
+
+    for (i = 0; i < size; ++i)
+    {
+        words[i] = code_memory[i].word;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, APEX_IMAGE_MAGIC, sizeof(header.magic));
+    header.version = APEX_IMAGE_VERSION;
+    header.num_insns = size;
+    header.source_hash = source_hash;
+    header.checksum = image_hash(words, size * sizeof(uint32_t));
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+    fd = mkstemp(tmp_path);
+    if (fd >= 0)
+    {
+        /* mkstemp creates the file private to the user */
+        fchmod(fd, 0644);
+    }
+    fp = fd < 0 ? NULL : fdopen(fd, "wb");
+    if (!fp)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+            unlink(tmp_path);
+        }
+        free(words);
+        return FALSE;
+    }
+
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(words, sizeof(uint32_t), size, fp) == (size_t)size;
+    ok = (fclose(fp) == 0) && ok;
+    free(words);
+
+    if (!ok || rename(tmp_path, path) != 0)
+    {
+        unlink(tmp_path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Writes the code memory assembled from source text [text, text + length)
+ * as an image at path. Returns TRUE on success.
+ */
+int
+APEX_image_write(const char *path, const APEX_Instruction *code_memory, int size,
+                 const void *text, size_t length)
+{
+    return image_write(path, code_memory, size, image_hash(text, length));
+}
+
+/* Directory of the assembled program cache, or NULL if caching is off */
+static const char *
+cache_dir(void)
+{
+    const char *dir = getenv(APEX_CACHE_ENV);
+
+    return (dir && *dir) ? dir : NULL;
+}
+
+/*
+ * Loads the cached image of source text [text, text + length). Returns NULL
+ * when caching is off or the text has no valid cached image yet.
+ */
+APEX_Instruction *
+APEX_image_cache_load(const void *text, size_t length, int *size)
+{
+    char path[MAX_BATCH_PATH];
+    APEX_Instruction *code_memory = NULL;
+    const APEX_Image_Header *header;
+    const char *dir = cache_dir();
+    uint64_t source_hash;
+    void *image;
+    long image_size;
+    FILE *fp;
+
+    if (!dir)
+    {
+        return NULL;
+    }
+
+    source_hash = image_hash(text, length);
+    snprintf(path, sizeof(path), "%s/%016llx.apeximg", dir, (unsigned long long)source_hash);
+    fp = fopen(path, "rb");
+    if (!fp)
+    {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    image_size = ftell(fp);
+    rewind(fp);
+
+    image = image_size > 0 ? malloc(image_size) : NULL;
+    if (image && fread(image, image_size, 1, fp) == 1)
+    {
+        header = image;
+
+        /* Images of an older format or of other text are rebuilt */
+        if (APEX_image_check(image, image_size) && header->version == APEX_IMAGE_VERSION &&
+            header->source_hash == source_hash)
+        {
+            code_memory = APEX_image_decode(image, image_size, path, size);
+        }
+    }
+
+    free(image);
+    fclose(fp);
+    return code_memory;
+}
+
+/* Stores the code memory parsed from source text in the cache, if enabled */
+void
+APEX_image_cache_store(const void *text, size_t length, const APEX_Instruction *code_memory,
+                       int size)
+{
+    char path[MAX_BATCH_PATH];
+    const char *dir = cache_dir();
+    uint64_t source_hash;
+
+    if (!dir)
+    {
+        return;
+    }
+
+    source_hash = image_hash(text, length);
+    snprintf(path, sizeof(path), "%s/%016llx.apeximg", dir, (unsigned long long)source_hash);
+    if (!image_write(path, code_memory, size, source_hash))
+    {
+        fprintf(stderr, "APEX_Warning: unable to write program cache %s\n", path);
+    }
+}
@@ -0,0 +1,246 @@
+/*
+ * apex_isa.c
+ * Per-opcode descriptors of the APEX instruction set
+ *
+ * Decode, execute and writeback look up what an instruction needs here
+ * (functional unit class, registers read, whether it writes rd or the
+ * zero flag) instead of switching on the opcode in every stage. Adding an
+ * instruction means adding its row here and its operation in the FU.
+ *
+ * The table also defines the 32-bit encoding of every instruction:
+ *
+ *     31    27 26                                                 0
+ *     | opcode | 4-bit register fields | signed immediate         |
+ *
+ * The register fields hold rd, rs1, rs2 and rs3, in that order, for the
+ * ones the opcode uses (writes_rd, sources); the immediate, if has_imm,
+ * takes every bit below them. MOVC thus has a 23-bit immediate, LOAD a
+ * 19-bit one and BZ a 27-bit branch offset.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* rd: writes_rd, zf: sets_zero, bz: reads_zero, im: has_imm */
+const APEX_OpInfo APEX_op_info[NUM_OPCODES] = {
+    /*                mnemonic fu       sources                       rd zf bz im */
+    [OPCODE_ADD]   = {"ADD",   FU_INT,  SRC_RS1 | SRC_RS2,            1, 1, 0, 0},
+    [OPCODE_SUB]   = {"SUB",   FU_INT,  SRC_RS1 | SRC_RS2,            1, 1, 0, 0},
+    [OPCODE_MUL]   = {"MUL",   FU_MUL,  SRC_RS1 | SRC_RS2,            1, 1, 0, 0},
+    [OPCODE_DIV]   = {"DIV",   FU_NONE, SRC_RS1 | SRC_RS2,            1, 0, 0, 0},
+    [OPCODE_AND]   = {"AND",   FU_INT,  SRC_RS1 | SRC_RS2,            1, 0, 0, 0},
+    [OPCODE_OR]    = {"OR",    FU_INT,  SRC_RS1 | SRC_RS2,            1, 0, 0, 0},
+    [OPCODE_XOR]   = {"EXOR",  FU_INT,  SRC_RS1 | SRC_RS2,            1, 0, 0, 0},
+    [OPCODE_MOVC]  = {"MOVC",  FU_INT,  0,                            1, 0, 0, 1},
+    [OPCODE_LOAD]  = {"LOAD",  FU_LS,   SRC_RS1,                      1, 0, 0, 1},
+    [OPCODE_STORE] = {"STORE", FU_LS,   SRC_RS1 | SRC_RS2,            0, 0, 0, 1},
+    [OPCODE_BZ]    = {"BZ",    FU_INT,  0,                            0, 0, 1, 1},
+    [OPCODE_BNZ]   = {"BNZ",   FU_INT,  0,                            0, 0, 1, 1},
+    [OPCODE_HALT]  = {"HALT",  FU_INT,  0,                            0, 0, 0, 0},
+    [OPCODE_ADDL]  = {"ADDL",  FU_INT,  SRC_RS1,                      1, 1, 0, 1},
+    [OPCODE_SUBL]  = {"SUBL",  FU_INT,  SRC_RS1,                      1, 1, 0, 1},
+    [OPCODE_NOP]   = {"NOP",   FU_INT,  0,                            0, 0, 0, 0},
+    [OPCODE_CMP]   = {"CMP",   FU_INT,  SRC_RS1 | SRC_RS2,            0, 1, 0, 0},
+    [OPCODE_LDR]   = {"LDR",   FU_LS,   SRC_RS1 | SRC_RS2,            1, 0, 0, 0},
+    [OPCODE_STR]   = {"STR",   FU_LS,   SRC_RS1 | SRC_RS2 | SRC_RS3,  0, 0, 0, 0},
+};
+
+/*
+ * Perfect hash of the mnemonics above: the first two characters, the last
+ * one and the length pick one of OPCODE_HASH_SIZE slots, and no two
+ * mnemonics share a slot. A slot holds the only opcode that can match, so a
+ * lookup is one hash and one compare instead of a strcmp per opcode.
+ *
+ * When adding an opcode, give it a free slot (changing the multipliers if
+ * needed); empty slots are 0 and rejected by the mnemonic compare.
+ */
+#define OPCODE_HASH_SIZE 32
+
+static int
+opcode_hash(const unsigned char *s, int len)
+{
+    return (s[0] + 2 * s[1] + 5 * s[len - 1] + len) & (OPCODE_HASH_SIZE - 1);
+}
+
+static const int opcode_slots[OPCODE_HASH_SIZE] = {
+    [0] = OPCODE_ADD,   [2] = OPCODE_LOAD,  [3] = OPCODE_BNZ,   [7] = OPCODE_DIV,
+    [9] = OPCODE_ADDL,  [10] = OPCODE_SUB,  [15] = OPCODE_OR,   [16] = OPCODE_CMP,
+    [17] = OPCODE_LDR,  [18] = OPCODE_HALT, [19] = OPCODE_XOR,  [20] = OPCODE_AND,
+    [22] = OPCODE_MUL,  [24] = OPCODE_STR,  [25] = OPCODE_STORE, [26] = OPCODE_BZ,
+    [29] = OPCODE_SUBL, [30] = OPCODE_MOVC, [31] = OPCODE_NOP,
+};
+
+/*
+ * Looks up the opcode of the first len characters of mnemonic, which need
+ * not be NUL terminated. Returns -1 if it is not an APEX mnemonic.
+ */
+int
+APEX_opcode_lookup(const char *mnemonic, int len)
+{
+    const char *name;
+    int opcode;
+
+    /* The hash reads two characters; every mnemonic has at least two */
+    if (len < 2)
+    {
+        return -1;
+    }
+
+    opcode = opcode_slots[opcode_hash((const unsigned char *)mnemonic, len)];
+    name = APEX_op_info[opcode].mnemonic;
+
+    if (strncmp(name, mnemonic, len) != 0 || name[len] != '\0')
+    {
+        return -1;
+    }
+
+    return opcode;
+}
+
+#define WORD_BITS 32
+#define OPCODE_BITS 5
+#define REG_FIELD_BITS 4
+
+/*
+ * Fields of an opcode's encoding: which of rd, rs1, rs2, rs3 it has, in
+ * order, and the width of its immediate (0 if it has none).
+ */
+static int
+encoding_fields(const APEX_OpInfo *info, int **fields, APEX_Instruction *ins)
+{
+    int bits = WORD_BITS - OPCODE_BITS;
+    int n = 0;
+
+    if (info->writes_rd)
+    {
+        fields[n++] = &ins->rd;
+    }
+    if (info->sources & SRC_RS1)
+    {
+        fields[n++] = &ins->rs1;
+    }
+    if (info->sources & SRC_RS2)
+    {
+        fields[n++] = &ins->rs2;
+    }
+    if (info->sources & SRC_RS3)
+    {
+        fields[n++] = &ins->rs3;
+    }
+    fields[n] = NULL;
+
+    bits -= n * REG_FIELD_BITS;
+    return info->has_imm ? bits : 0;
+}
+
+/*
+ * Encodes an instruction into its 32-bit word. Returns FALSE if a register
+ * is outside the register file or the immediate does not fit its field.
+ */
+int
+APEX_encode_word(const APEX_Instruction *ins, uint32_t *word)
+{
+    APEX_Instruction copy = *ins;
+    int *fields[4 + 1];
+    int shift = WORD_BITS - OPCODE_BITS;
+    int imm_bits, i;
+
+    if (ins->opcode < 0 || ins->opcode >= NUM_OPCODES)
+    {
+        return FALSE;
+    }
+
+    imm_bits = encoding_fields(&APEX_op_info[ins->opcode], fields, &copy);
+    *word = (uint32_t)ins->opcode << shift;
+
+    for (i = 0; fields[i]; ++i)
+    {
+        if (*fields[i] < 0 || *fields[i] >= REG_FILE_SIZE)
+        {
+            return FALSE;
+        }
+        shift -= REG_FIELD_BITS;
+        *word |= (uint32_t)*fields[i] << shift;
+    }
+
+    if (imm_bits)
+    {
+        int64_t limit = (int64_t)1 << (imm_bits - 1);
+
+        if (ins->imm < -limit || ins->imm >= limit)
+        {
+            return FALSE;
+        }
+        *word |= (uint32_t)ins->imm & (((uint32_t)1 << imm_bits) - 1);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Decodes a 32-bit word into an instruction; fields the opcode does not use
+ * are 0. Returns FALSE if the opcode is unknown.
+ */
+int
+APEX_decode_word(uint32_t word, APEX_Instruction *ins)
+{
+    int *fields[4 + 1];
+    int shift = WORD_BITS - OPCODE_BITS;
+    int imm_bits, i;
+
+    memset(ins, 0, sizeof(*ins));
+    ins->opcode = word >> shift;
+    if (ins->opcode >= NUM_OPCODES)
+    {
+        return FALSE;
+    }
+
+    imm_bits = encoding_fields(&APEX_op_info[ins->opcode], fields, ins);
+
+    for (i = 0; fields[i]; ++i)
+    {
+        shift -= REG_FIELD_BITS;
+        *fields[i] = (word >> shift) & ((1 << REG_FIELD_BITS) - 1);
+    }
+
+    if (imm_bits)
+    {
+        /* Sign extend the low imm_bits bits */
+        ins->imm = (int32_t)(word << (WORD_BITS - imm_bits)) >> (WORD_BITS - imm_bits);
+    }
+
+    ins->word = word;
+    return TRUE;
+}
+
+/*
+ * Points every instruction of code memory at its opcode descriptor. Run once
+ * after a program is loaded so the pipeline never has to check the opcode.
+ *
+ * Returns TRUE, or FALSE if an instruction has an unknown opcode.
+ */
+int
+APEX_predecode(APEX_Instruction *code_memory, int code_memory_size)
+{
+    int i;
+
+    for (i = 0; i < code_memory_size; ++i)
+    {
+        APEX_Instruction *ins = &code_memory[i];
+
+        if (ins->opcode < 0 || ins->opcode >= NUM_OPCODES)
+        {
+            fprintf(stderr, "APEX_Error: pc(%d) has unknown opcode %d\n", 4000 + i * 4,
+                    ins->opcode);
+            return FALSE;
+        }
+
+        ins->info = &APEX_op_info[ins->opcode];
+    }
+
+    return TRUE;
+}
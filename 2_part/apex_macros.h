@@ -39,12 +39,200 @@
 #define OPCODE_LDR 0x11
 #define OPCODE_STR 0x12
 
+/* Number of opcodes, size of the opcode descriptor table */
+#define NUM_OPCODES 0x13
+
+/* Functional unit classes; the id is also the writeback queue entry */
+#define FU_NONE 0x0
+#define FU_INT 0x1
+#define FU_MUL 0x2
+#define FU_LS 0x3
+#define NUM_FU_CLASSES 0x4
+
+/* Default cycles an instruction spends in each functional unit */
+#define INT_FU_LATENCY 1
+#define MUL_FU_LATENCY 3
+#define LS_FU_LATENCY 4
+
+/* Limits of the functional unit configuration */
+#define MAX_FU_INSTANCES 4
+#define MAX_FU_LATENCY 64
+
+/* Instructions in flight in all units of one class; a pipelined unit holds
+ * up to its latency. Every one may wait in the writeback queue, so
+ * MAX_FU_SLOTS times the FU classes (FU_NONE aside) must not exceed
+ * MAX_QUEUE_SIZE */
+#define MAX_FU_SLOTS 32
+
+/* Values of the forwarding setting: no bypass, bypass from the writeback
+ * latch, and also from results waiting in the functional units */
+#define FORWARD_NONE 0
+#define FORWARD_WRITEBACK 1
+#define FORWARD_ALL 2
+
+/* Branch direction predictors, the values of the bpred setting */
+#define BPRED_NOT_TAKEN 0
+#define BPRED_BACKWARD_TAKEN 1
+#define BPRED_BIMODAL 2
+#define BPRED_GSHARE 3
+#define BPRED_TOURNAMENT 4
+#define NUM_BPREDS 5
+
+/* Limits of the predictor tables (2-bit counters) and of the branch target
+ * buffer, as log2 of their entries */
+#define MAX_BPRED_TABLE_BITS 12
+#define MAX_BTB_BITS 10
+
+/* Default predictor table, global history and BTB sizes */
+#define BPRED_TABLE_BITS 10
+#define BPRED_HISTORY_BITS 8
+#define BTB_BITS 6
+
+/* Cache replacement policies, the values of the dcache_replacement setting */
+#define CACHE_LRU 0
+#define CACHE_PLRU 1
+#define CACHE_RANDOM 2
+#define NUM_CACHE_POLICIES 3
+
+/* Cache write policies: write-back with write-allocate, or write-through
+ * without allocation on a store miss */
+#define CACHE_WRITE_BACK 0
+#define CACHE_WRITE_THROUGH 1
+#define NUM_CACHE_WRITE_POLICIES 2
+
+/* Limits of a cache: lines in all, ways per set, and words per line */
+#define MAX_CACHE_LINES 1024
+#define MAX_CACHE_ASSOC 16
+#define MAX_CACHE_LINE_SIZE 64
+#define MAX_CACHE_SIZE (MAX_CACHE_LINES * MAX_CACHE_LINE_SIZE)
+
+/* Default instruction cache geometry (in instructions) and latencies */
+#define ICACHE_SIZE 256
+#define ICACHE_LINE_SIZE 8
+#define ICACHE_ASSOC 2
+#define ICACHE_HIT_LATENCY 1
+#define ICACHE_MISS_LATENCY 20
+
+/* Limits of the instructions fetched per cycle and of the fetch buffer */
+#define MAX_FETCH_WIDTH 4
+#define MAX_FETCH_BUFFER 16
+
+/* Default data cache geometry (in data memory words) and latencies */
+#define DCACHE_SIZE 256
+#define DCACHE_LINE_SIZE 8
+#define DCACHE_ASSOC 2
+#define DCACHE_HIT_LATENCY 2
+#define DCACHE_MISS_LATENCY 20
+
+/* Data cache prefetchers, the values of the prefetch setting */
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXT_LINE 1
+#define PREFETCH_STRIDE 2
+#define NUM_PREFETCHERS 3
+
+/* Limits of the stride table (log2 entries) and of the lines prefetched
+ * ahead per access and how far ahead they start */
+#define MAX_PREFETCH_TABLE_BITS 10
+#define MAX_PREFETCH_DEGREE 8
+#define MAX_PREFETCH_DISTANCE 16
+
+/* Default stride table size, degree and distance */
+#define PREFETCH_TABLE_BITS 6
+#define PREFETCH_DEGREE 1
+#define PREFETCH_DISTANCE 1
+
+/* Default cycles a load takes when the load/store queue forwards it the data
+ * of an older store */
+#define LSQ_FORWARD_LATENCY 1
+
+/* Main memory timing models, the values of the memory setting: a fixed
+ * latency (ls_fu_latency, or dcache_miss_latency behind the data cache) or
+ * banked DRAM */
+#define MEMORY_FLAT 0
+#define MEMORY_DRAM 1
+#define NUM_MEMORY_MODELS 2
+
+/* Limits of the DRAM banks, row size (words), timing parameters (cycles)
+ * and outstanding requests */
+#define MAX_DRAM_BANKS 16
+#define MAX_DRAM_ROW_SIZE 4096
+#define MAX_DRAM_TIMING 64
+#define MAX_DRAM_QUEUE 32
+
+/* Default DRAM organisation and timing */
+#define DRAM_BANKS 4
+#define DRAM_ROW_SIZE 256
+#define DRAM_TRCD 6
+#define DRAM_TCAS 6
+#define DRAM_TRP 6
+#define DRAM_BURST 2
+#define DRAM_QUEUE 8
+
+/* Registers the out-of-order core renames: the register file and, as one
+ * more, the zero flag */
+#define ARCH_ZERO_FLAG REG_FILE_SIZE
+#define NUM_ARCH_REGS (REG_FILE_SIZE + 1)
+
+/* Limits of the out-of-order core: reorder buffer and issue queue entries,
+ * physical registers, and instructions renamed and committed per cycle */
+#define MAX_ROB_SIZE 128
+#define MAX_IQ_SIZE 64
+#define MAX_PHYS_REGS 256
+#define MAX_OOO_WIDTH 4
+
+/* Default reorder buffer, issue queue and physical register file sizes */
+#define ROB_SIZE 32
+#define IQ_SIZE 16
+#define PHYS_REGS 64
+
+/* Instructions the in-order pipeline issues and writes back per cycle */
+#define MAX_ISSUE_WIDTH 4
+
+/* Where decode got a source operand from */
+#define OPERAND_REG_FILE 0
+#define OPERAND_FROM_WRITEBACK 1
+#define OPERAND_FROM_FU 2
+#define NUM_OPERAND_SOURCES 3
+
+/* Source register operands read by an opcode */
+#define SRC_RS1 0x1
+#define SRC_RS2 0x2
+#define SRC_RS3 0x4
+
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
 
 /* Set this flag to 1 to enable cycle single-step mode */
 #define ENABLE_SINGLE_STEP 1
 
+/* Reasons for a simulation loop to return */
+#define APEX_SIM_HALTED 0x1
+#define APEX_SIM_CYCLE_LIMIT 0x2
+#define APEX_SIM_USER_QUIT 0x3
+#define APEX_SIM_INSN_LIMIT 0x4
+#define APEX_SIM_FAULT 0x5
+#define APEX_SIM_STOP_REQUESTED 0x6
+
+/* Maximum number of observers attached to one CPU */
+#define MAX_OBSERVERS 8
+
+/* Asks the compiler to inline everything called from a function, or to
+ * keep a function out of line even then */
+#ifdef __GNUC__
+#define APEX_FLATTEN __attribute__((flatten))
+#define APEX_NOINLINE __attribute__((noinline))
+#else
+#define APEX_FLATTEN
+#define APEX_NOINLINE
+#endif
+
+/* Batch runner limits */
+#define MAX_BATCH_THREADS 256
+#define MAX_BATCH_PATH 1024
+
+/* Format version of binary program images, bump on any layout change */
+#define APEX_IMAGE_VERSION 2
+
 /*max queue size*/
 #define MAX_QUEUE_SIZE 100
 
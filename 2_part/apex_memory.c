@@ -0,0 +1,204 @@
+/*
+ * apex_memory.c
+ * Main memory timing: banked DRAM behind the load/store FUs
+ *
+ * The memory setting picks the model. MEMORY_FLAT keeps the fixed latencies
+ * of the load/store FU and of data cache misses, and never calls in here.
+ * With MEMORY_DRAM every access that reaches memory (a load or store
+ * without the data cache, a line fill, writeback or write-through store
+ * with it) is timed here. A new model adds a MEMORY_ value, its name and a
+ * case in APEX_memory_access.
+ *
+ * Data memory words are split into rows of dram_row_size words, and
+ * consecutive rows go to consecutive banks. Each bank keeps its last row
+ * open (open page policy): an access to the open row takes tCAS, to a
+ * closed bank tRCD + tCAS, and to another row tRP + tRCD + tCAS. The data
+ * then holds the bus, shared by all banks, for dram_burst cycles. The
+ * controller serves requests in arrival order and keeps at most dram_queue
+ * outstanding; a request that finds the queue full waits for the oldest to
+ * complete.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+const char *const APEX_memory_names[NUM_MEMORY_MODELS + 1] = {
+    [MEMORY_FLAT] = "flat", [MEMORY_DRAM] = "dram", NULL,
+};
+
+/* Sets up closed banks and an empty request queue */
+void
+APEX_memory_init(APEX_Memory *memory, const APEX_Config *config)
+{
+    int i;
+
+    memset(memory, 0, sizeof(*memory));
+    memory->model = config->memory;
+    memory->banks_count = config->dram_banks;
+    memory->row_size = config->dram_row_size;
+    memory->trcd = config->dram_trcd;
+    memory->tcas = config->dram_tcas;
+    memory->trp = config->dram_trp;
+    memory->burst = config->dram_burst;
+    memory->queue = config->dram_queue;
+
+    for (i = 0; i < MAX_DRAM_BANKS; ++i)
+    {
+        memory->banks[i].open_row = -1;
+    }
+}
+
+/*
+ * Forgets the requests in flight and the statistics, for a pipeline that
+ * starts over with a new clock. Open rows stay open.
+ */
+void
+APEX_memory_reset(APEX_Memory *memory)
+{
+    int i;
+
+    for (i = 0; i < MAX_DRAM_BANKS; ++i)
+    {
+        memory->banks[i].busy_until = 0;
+    }
+    memory->bus_free = 0;
+    memory->num_pending = 0;
+
+    memory->reads = 0;
+    memory->writes = 0;
+    memory->row_hits = 0;
+    memory->row_misses = 0;
+    memory->row_conflicts = 0;
+    memory->latency = 0;
+    memory->queue_cycles = 0;
+    memory->bank_cycles = 0;
+}
+
+/* Cycle a new request can start at: once it has a queue entry */
+static long long
+memory_enqueue(APEX_Memory *memory, long long now)
+{
+    long long start = now;
+    int i, kept = 0, oldest = 0;
+
+    /* Retire the requests that have completed */
+    for (i = 0; i < memory->num_pending; ++i)
+    {
+        if (memory->pending[i] > now)
+        {
+            memory->pending[kept++] = memory->pending[i];
+        }
+    }
+    memory->num_pending = kept;
+
+    if (memory->num_pending == memory->queue)
+    {
+        for (i = 1; i < memory->num_pending; ++i)
+        {
+            if (memory->pending[i] < memory->pending[oldest])
+            {
+                oldest = i;
+            }
+        }
+
+        start = memory->pending[oldest];
+        memory->queue_cycles += start - now;
+        memory->pending[oldest] = memory->pending[--memory->num_pending];
+    }
+
+    return start;
+}
+
+/*
+ * Times a read (is_write FALSE) or write of the row holding address,
+ * issued at cycle now. Returns the cycles until its data has crossed the
+ * bus; the bank, bus and queue stay busy for later requests accordingly.
+ */
+int
+APEX_memory_access(APEX_Memory *memory, int address, int is_write, long long now)
+{
+    unsigned int row_index = (unsigned int)address / memory->row_size;
+    APEX_DRAM_Bank *bank = &memory->banks[row_index % memory->banks_count];
+    int row = row_index / memory->banks_count;
+    long long start, ready, done;
+    int access;
+
+    start = memory_enqueue(memory, now);
+    if (bank->busy_until > start)
+    {
+        memory->bank_cycles += bank->busy_until - start;
+        start = bank->busy_until;
+    }
+
+    if (bank->open_row == row)
+    {
+        memory->row_hits++;
+        access = memory->tcas;
+    }
+    else if (bank->open_row < 0)
+    {
+        memory->row_misses++;
+        access = memory->trcd + memory->tcas;
+    }
+    else
+    {
+        memory->row_conflicts++;
+        access = memory->trp + memory->trcd + memory->tcas;
+    }
+    bank->open_row = row;
+    bank->busy_until = start + access;
+
+    ready = start + access;
+    if (memory->bus_free > ready)
+    {
+        ready = memory->bus_free;
+    }
+    done = ready + memory->burst;
+    memory->bus_free = done;
+    memory->pending[memory->num_pending++] = done;
+
+    if (is_write)
+    {
+        memory->writes++;
+    }
+    else
+    {
+        memory->reads++;
+    }
+    memory->latency += done - now;
+    return done - now;
+}
+
+void
+APEX_memory_print_stats(const APEX_Memory *memory)
+{
+    long long accesses = memory->reads + memory->writes;
+    double percent = accesses ? 100.0 / accesses : 0.0;
+
+    printf("================MAIN MEMORY==================\n");
+    printf("Model                       : %s\n", APEX_memory_names[memory->model]);
+    if (memory->model == MEMORY_FLAT)
+    {
+        return;
+    }
+
+    printf("Banks, row size             : %d, %d words\n", memory->banks_count,
+           memory->row_size);
+    printf("tRCD, tCAS, tRP, burst      : %d, %d, %d, %d\n", memory->trcd, memory->tcas,
+           memory->trp, memory->burst);
+    printf("Reads                       : %12lld\n", memory->reads);
+    printf("Writes                      : %12lld\n", memory->writes);
+    printf("Row hits                    : %12lld (%6.2f%%)\n", memory->row_hits,
+           percent * memory->row_hits);
+    printf("Row misses (bank closed)    : %12lld (%6.2f%%)\n", memory->row_misses,
+           percent * memory->row_misses);
+    printf("Row conflicts               : %12lld (%6.2f%%)\n", memory->row_conflicts,
+           percent * memory->row_conflicts);
+    printf("Average latency             : %12.2f\n",
+           accesses ? (double)memory->latency / accesses : 0.0);
+    printf("Cycles waiting for queue    : %12lld\n", memory->queue_cycles);
+    printf("Cycles waiting for banks    : %12lld\n", memory->bank_cycles);
+}
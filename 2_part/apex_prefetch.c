@@ -0,0 +1,213 @@
+/*
+ * apex_prefetch.c
+ * Data cache prefetchers
+ *
+ * The prefetch setting picks the prefetcher. It sees every load and store
+ * the load/store FU sends to the data cache, after the access, and asks
+ * the cache to fill the lines it expects next with APEX_cache_prefetch.
+ * Lines the cache already holds, or is filling, are dropped there. A new
+ * prefetcher adds a PREFETCH_ value, its name and a case in
+ * APEX_prefetch_access.
+ *
+ * next_line (tagged prefetching, Smith): an access that misses, or is the
+ * first to a prefetched line, fetches the prefetch_degree lines starting
+ * prefetch_distance lines past its own.
+ *
+ * stride (reference prediction table, Chen and Baer): a direct mapped
+ * table indexed by the PC of the load or store keeps its last address and
+ * the stride between its last two. A 2-bit confidence counts up when the
+ * stride repeats and down when it does not, and a new stride is only taken
+ * once it has dropped to zero. From a confidence of 2 every access fetches
+ * the lines of the prefetch_degree addresses starting prefetch_distance
+ * strides ahead.
+ *
+ * The cache counts what became of the prefetched lines: accessed in time,
+ * accessed while still being filled (late), or evicted unused.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* Confidence the stride prefetcher needs, and its maximum */
+#define STRIDE_CONFIDENT 2
+#define STRIDE_CONFIDENCE_MAX 3
+
+const char *const APEX_prefetch_names[NUM_PREFETCHERS + 1] = {
+    [PREFETCH_NONE] = "none", [PREFETCH_NEXT_LINE] = "next_line", [PREFETCH_STRIDE] = "stride",
+    NULL,
+};
+
+/* Sets up an empty stride table */
+void
+APEX_prefetch_init(APEX_Prefetcher *pf, const APEX_Config *config)
+{
+    int i;
+
+    memset(pf, 0, sizeof(*pf));
+    pf->kind = config->prefetch;
+    pf->table_mask = (1 << config->prefetch_table_bits) - 1;
+    pf->degree = config->prefetch_degree;
+    pf->distance = config->prefetch_distance;
+
+    for (i = 0; i < (1 << MAX_PREFETCH_TABLE_BITS); ++i)
+    {
+        pf->table[i].pc = -1;
+    }
+}
+
+void
+APEX_prefetch_reset_stats(APEX_Prefetcher *pf)
+{
+    pf->triggers = 0;
+    pf->requests = 0;
+    pf->redundant = 0;
+}
+
+/* Asks the cache for the line holding address, if it is in data memory */
+static void
+prefetch_line(APEX_Prefetcher *pf, APEX_Cache *cache, APEX_Memory *memory, int address,
+              long long now)
+{
+    if (address < 0 || address >= DATA_MEMORY_SIZE)
+    {
+        return;
+    }
+
+    pf->requests++;
+    if (!APEX_cache_prefetch(cache, memory, address, now))
+    {
+        pf->redundant++;
+    }
+}
+
+/* Updates the stride table entry of pc; returns its stride once confident */
+static int
+stride_train(APEX_Prefetcher *pf, int pc, int address)
+{
+    APEX_Prefetch_Entry *entry = &pf->table[(pc >> 2) & pf->table_mask];
+    int stride;
+
+    if (entry->pc != pc)
+    {
+        entry->pc = pc;
+        entry->address = address;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return 0;
+    }
+
+    stride = address - entry->address;
+    entry->address = address;
+    if (stride == entry->stride)
+    {
+        if (entry->confidence < STRIDE_CONFIDENCE_MAX)
+        {
+            entry->confidence++;
+        }
+    }
+    else if (entry->confidence > 0)
+    {
+        entry->confidence--;
+    }
+    else
+    {
+        entry->stride = stride;
+    }
+
+    return entry->confidence >= STRIDE_CONFIDENT ? entry->stride : 0;
+}
+
+/*
+ * Trains on the access of the load or store at pc to address, which the
+ * cache has just served at cycle now, and issues the prefetches it
+ * predicts.
+ */
+void
+APEX_prefetch_access(APEX_Prefetcher *pf, APEX_Cache *cache, APEX_Memory *memory, int pc,
+                     int address, long long now)
+{
+    int line_size = cache->config.line_size;
+    int i, stride, line, last_line;
+
+    switch (pf->kind)
+    {
+        case PREFETCH_NEXT_LINE:
+            if (!cache->trigger)
+            {
+                return;
+            }
+
+            pf->triggers++;
+            line = address / line_size + pf->distance;
+            for (i = 0; i < pf->degree; ++i)
+            {
+                prefetch_line(pf, cache, memory, (line + i) * line_size, now);
+            }
+            break;
+
+        case PREFETCH_STRIDE:
+            stride = stride_train(pf, pc, address);
+            if (!stride)
+            {
+                return;
+            }
+
+            /* Strides shorter than a line would ask for a line repeatedly */
+            pf->triggers++;
+            last_line = address / line_size;
+            for (i = 0; i < pf->degree; ++i)
+            {
+                int target = address + stride * (pf->distance + i);
+
+                if (target / line_size != last_line)
+                {
+                    last_line = target / line_size;
+                    prefetch_line(pf, cache, memory, target, now);
+                }
+            }
+            break;
+    }
+}
+
+/*
+ * Prints the prefetches asked for and filled, and what became of them:
+ * coverage is the share of the misses there would have been that prefetched
+ * lines served, accuracy the share of filled lines that were accessed, and
+ * timeliness the share of those that were ready in time.
+ */
+void
+APEX_prefetch_print_stats(const APEX_Prefetcher *pf, const APEX_Cache *cache)
+{
+    long long misses = cache->read_misses + cache->write_misses;
+    long long useful = cache->prefetch_hits;
+
+    printf("================DATA PREFETCHER==================\n");
+    printf("Prefetcher                  : %s\n", APEX_prefetch_names[pf->kind]);
+    if (pf->kind == PREFETCH_NONE)
+    {
+        return;
+    }
+
+    if (pf->kind == PREFETCH_STRIDE)
+    {
+        printf("Table entries               : %d\n", pf->table_mask + 1);
+    }
+    printf("Degree, distance            : %d, %d\n", pf->degree, pf->distance);
+    printf("Triggers                    : %12lld\n", pf->triggers);
+    printf("Lines requested             : %12lld\n", pf->requests);
+    printf("Already cached              : %12lld\n", pf->redundant);
+    printf("Lines prefetched            : %12lld\n", cache->prefetches);
+    printf("Useful                      : %12lld\n", useful);
+    printf("Late                        : %12lld (%lld cycles)\n", cache->prefetch_late,
+           cache->prefetch_late_cycles);
+    printf("Evicted unused              : %12lld\n", cache->prefetch_unused);
+    printf("Coverage                    : %11.2f%%\n",
+           useful + misses ? 100.0 * useful / (useful + misses) : 0.0);
+    printf("Accuracy                    : %11.2f%%\n",
+           cache->prefetches ? 100.0 * useful / cache->prefetches : 0.0);
+    printf("Timeliness                  : %11.2f%%\n",
+           useful ? 100.0 * (useful - cache->prefetch_late) / useful : 0.0);
+}
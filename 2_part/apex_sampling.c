@@ -0,0 +1,259 @@
+/*
+ * apex_sampling.c
+ * Statistical sampling of pipeline CPI (SMARTS style)
+ *
+ * The program runs in functional mode from start to end. Every `period`
+ * instructions a detailed window is taken: a copy of the CPU is handed to
+ * the cycle accurate pipeline, which retires `warmup` instructions to fill
+ * the pipeline and then `measure` instructions whose cycles are counted.
+ * The copy is then discarded, so the architectural state always comes from
+ * the functional run and the detailed windows only contribute timing.
+ *
+ * With the caches, a branch predictor or a prefetcher enabled the functional
+ * run between windows also trains them (functional warming), so a window
+ * starts with the tags, counters and stride table the program left behind
+ * instead of cold ones.
+ *
+ * The per-window CPIs give a mean CPI with a confidence interval, and mean
+ * CPI times the total instruction count estimates the total cycles.
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cpu.h"
+#include "apex_macros.h"
+
+/* z value of a two sided 95% confidence interval */
+#define SAMPLE_Z_95 1.96
+
+/* Detailed windows that do not retire enough instructions within this many
+ * cycles per instruction are abandoned */
+#define SAMPLE_MAX_CPI 1000
+
+typedef struct Sample_Window
+{
+    int warmup;
+    int measure;
+    int retired;
+    int start_clock;
+    int end_clock;
+} Sample_Window;
+
+static void
+sample_retire(APEX_CPU *cpu, const CPU_Stage *stage, void *ctx)
+{
+    Sample_Window *window = ctx;
+
+    window->retired++;
+
+    if (window->retired == window->warmup)
+    {
+        window->start_clock = cpu->clock;
+    }
+
+    if (window->retired == window->warmup + window->measure)
+    {
+        window->end_clock = cpu->clock;
+        cpu->stop_requested = TRUE;
+    }
+}
+
+/*
+ * Runs one detailed window on a copy of the CPU. Returns the number of
+ * cycles taken by the measured instructions, or -1 if the program ended or
+ * the window stalled before they all retired.
+ */
+static int
+sample_window(const APEX_CPU *cpu, int warmup, int measure)
+{
+    APEX_Observer observer;
+    Sample_Window window;
+    APEX_CPU *copy;
+    int status;
+
+    copy = APEX_cpu_clone(cpu);
+    if (!copy)
+    {
+        return -1;
+    }
+
+    APEX_cpu_reset_pipeline(copy);
+    copy->clock = 1;
+    copy->insn_completed = 0;
+    copy->single_step = 0;
+
+    memset(&window, 0, sizeof(window));
+    window.warmup = warmup;
+    window.measure = measure;
+    window.start_clock = copy->clock - 1;
+
+    memset(&observer, 0, sizeof(observer));
+    observer.retire = sample_retire;
+    observer.ctx = &window;
+    APEX_cpu_add_observer(copy, &observer);
+
+    status = APEX_cpu_loop(copy, 1 + SAMPLE_MAX_CPI * (warmup + measure));
+    APEX_cpu_stop(copy);
+
+    if (status != APEX_SIM_STOP_REQUESTED)
+    {
+        return -1;
+    }
+
+    return window.end_clock - window.start_clock;
+}
+
+/*
+ * Whether the functional run has to warm any structure the windows use
+ */
+static int
+sample_needs_warming(const APEX_CPU *cpu)
+{
+    return cpu->config.icache.enabled || cpu->config.dcache.enabled ||
+           cpu->config.bpred != BPRED_NOT_TAKEN;
+}
+
+/*
+ * Runs up to maxInsns instructions functionally like APEX_functional_run,
+ * one at a time, and before each one accesses the instruction cache, the
+ * data cache and prefetcher for loads and stores, and the branch predictor
+ * for BZ/BNZ the way the pipeline would. Timing is ignored: every access is
+ * made at cycle 0.
+ */
+static int
+sample_warm(APEX_CPU *cpu, int maxInsns)
+{
+    int status = APEX_SIM_INSN_LIMIT;
+    int executed;
+
+    for (executed = 0; executed < maxInsns && status == APEX_SIM_INSN_LIMIT; ++executed)
+    {
+        const APEX_Instruction *ins;
+        int index = (cpu->pc - 4000) / 4;
+        int address = -1;
+        int taken = FALSE;
+        int target;
+        int ctx;
+
+        if (index < 0 || index >= cpu->code_memory_size)
+        {
+            /* Let the functional run report the fault */
+            return APEX_functional_run(cpu, 1);
+        }
+
+        ins = &cpu->code_memory[index];
+
+        if (cpu->config.icache.enabled)
+        {
+            APEX_cache_access(&cpu->icache, NULL, index, FALSE, 0);
+        }
+
+        switch (ins->opcode)
+        {
+            case OPCODE_LOAD:
+                address = cpu->reg[ins->rs1].regs + ins->imm;
+                break;
+
+            case OPCODE_LDR:
+            case OPCODE_STR:
+                address = cpu->reg[ins->rs1].regs + cpu->reg[ins->rs2].regs;
+                break;
+
+            case OPCODE_STORE:
+                address = cpu->reg[ins->rs2].regs + ins->imm;
+                break;
+
+            case OPCODE_BZ:
+                taken = cpu->zero_flag;
+                break;
+
+            case OPCODE_BNZ:
+                taken = !cpu->zero_flag;
+                break;
+        }
+
+        if (cpu->config.dcache.enabled && address >= 0 && address < DATA_MEMORY_SIZE)
+        {
+            int is_write = ins->opcode == OPCODE_STORE || ins->opcode == OPCODE_STR;
+
+            APEX_cache_access(&cpu->dcache, NULL, address, is_write, 0);
+            if (cpu->config.prefetch != PREFETCH_NONE)
+            {
+                APEX_prefetch_access(&cpu->prefetch, &cpu->dcache, NULL, cpu->pc, address, 0);
+            }
+        }
+
+        if (ins->info->reads_zero)
+        {
+            APEX_bpred_predict(&cpu->bpred, cpu->pc, &target, &ctx);
+            APEX_bpred_update(&cpu->bpred, cpu->pc, ctx, taken, cpu->pc + ins->imm);
+        }
+
+        status = APEX_functional_run(cpu, 1);
+    }
+
+    return status;
+}
+
+/*
+ * Samples the program from cpu->pc to HALT. Returns the status of the final
+ * functional run (APEX_SIM_HALTED or APEX_SIM_FAULT) and fills in stats.
+ */
+int
+APEX_cpu_sample(APEX_CPU *cpu, int period, int warmup, int measure, APEX_Sample_Stats *stats)
+{
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    int warm = sample_needs_warming(cpu);
+    int status;
+    int cycles;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (measure < 1)
+    {
+        measure = 1;
+    }
+    if (period < warmup + measure)
+    {
+        period = warmup + measure;
+    }
+
+    do
+    {
+        cycles = sample_window(cpu, warmup, measure);
+        if (cycles >= 0)
+        {
+            double cpi = (double)cycles / measure;
+
+            sum += cpi;
+            sum_sq += cpi * cpi;
+            stats->samples++;
+        }
+        else
+        {
+            stats->windows_dropped++;
+        }
+
+        status = warm ? sample_warm(cpu, period) : APEX_functional_run(cpu, period);
+    } while (status == APEX_SIM_INSN_LIMIT);
+
+    if (stats->samples > 0)
+    {
+        stats->cpi_mean = sum / stats->samples;
+    }
+    if (stats->samples > 1)
+    {
+        double variance = (sum_sq - stats->samples * stats->cpi_mean * stats->cpi_mean) /
+                          (stats->samples - 1);
+
+        stats->cpi_stddev = variance > 0.0 ? sqrt(variance) : 0.0;
+        stats->cpi_ci95 = SAMPLE_Z_95 * stats->cpi_stddev / sqrt(stats->samples);
+    }
+
+    stats->instructions = cpu->insn_completed;
+    stats->est_cycles = stats->cpi_mean * stats->instructions;
+    return status;
+}
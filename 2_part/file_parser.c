@@ -3,192 +3,176 @@
  * Contains functions to parse input file and create code memory, you can edit
  * this file to add new instructions
  *
+ * The input file is mapped into memory and parsed in a single pass, straight
+ * from the mapping into a growing code memory array. One instruction per
+ * line, as
+ *
+ *     MNEMONIC [operand{,operand}]
+ *
+ * where an operand is a register (R0 to R15) or a literal (#-16), as the
+ * instruction expects. Blank lines, lines starting with '#' and anything
+ * after a ';' are ignored.
+ *
  * Author:
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
-#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "apex_cpu.h"
 #include "apex_macros.h"
 
-/*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
- */
-static int
-get_num_from_string(const char *buffer)
-{
-    char str[16];
-    int i, j = 0;
+/* Most operands taken by an APEX instruction */
+#define MAX_OPERANDS 3
 
-    for (i = 1; buffer[i] != '\0'; ++i)
-    {
-        str[j] = buffer[i];
-        j++;
-    }
-    str[j] = '\0';
+/* Code memory slots allocated before the first grow */
+#define INITIAL_CODE_MEMORY 64
 
-    return atoi(str);
+static int
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
 }
 
 /*
- * This function sets the numeric opcode to an instruction based on string value
- *
- * Note : you can edit this function to add new instructions
+ * Parses one operand: an R or # prefix followed by a signed decimal number
+ * that fits an int. Returns the position after it, with the prefix in
+ * *prefix, or NULL if the operand is malformed.
  */
-static int
-set_opcode_str(const char *opcode_str)
+static const char *
+parse_operand(const char *p, const char *end, char *prefix, int *value)
 {
-    if (strcmp(opcode_str, "ADD") == 0)
-    {
-        return OPCODE_ADD;
-    }
-
-    if (strcmp(opcode_str, "SUB") == 0)
-    {
-        return OPCODE_SUB;
-    }
-
-    if (strcmp(opcode_str, "MUL") == 0)
-    {
-        return OPCODE_MUL;
-    }
-
-    if (strcmp(opcode_str, "DIV") == 0)
-    {
-        return OPCODE_DIV;
-    }
-
-    if (strcmp(opcode_str, "AND") == 0)
-    {
-        return OPCODE_AND;
-    }
-
-    if (strcmp(opcode_str, "OR") == 0)
-    {
-        return OPCODE_OR;
-    }
-
-    if (strcmp(opcode_str, "EXOR") == 0)
-    {
-        return OPCODE_XOR;
-    }
-
-    if (strcmp(opcode_str, "MOVC") == 0)
-    {
-        return OPCODE_MOVC;
-    }
-
-    if (strcmp(opcode_str, "LOAD") == 0)
-    {
-        return OPCODE_LOAD;
-    }
-
-    if (strcmp(opcode_str, "STORE") == 0)
-    {
-        return OPCODE_STORE;
-    }
-
-    if (strcmp(opcode_str, "BZ") == 0)
-    {
-        return OPCODE_BZ;
-    }
+    int negative = FALSE;
+    int num = 0;
 
-    if (strcmp(opcode_str, "BNZ") == 0)
+    if (*p != 'R' && *p != 'r' && *p != '#')
     {
-        return OPCODE_BNZ;
-    }
-
-    if (strcmp(opcode_str, "HALT") == 0)
-    {
-        return OPCODE_HALT;
-    }
-
-    if (strcmp(opcode_str, "NOP") == 0)
-    {
-        return OPCODE_NOP;
-    }
-
-    if (strcmp(opcode_str, "ADDL") == 0)
-    {
-        return OPCODE_ADDL;
-    }
-
-    if (strcmp(opcode_str, "SUBL") == 0)
-    {
-        return OPCODE_SUBL;
+        return NULL;
     }
+    *prefix = *p == '#' ? '#' : 'R';
 
-    if (strcmp(opcode_str, "CMP") == 0)
+    if (++p < end && *p == '-')
     {
-        return OPCODE_CMP;
+        negative = TRUE;
+        p++;
     }
 
-    if (strcmp(opcode_str, "LDR") == 0)
+    if (p >= end || *p < '0' || *p > '9')
     {
-        return OPCODE_LDR;
+        return NULL;
     }
 
-    if (strcmp(opcode_str, "STR") == 0)
+    while (p < end && *p >= '0' && *p <= '9')
     {
-        return OPCODE_STR;
+        if (num > (INT_MAX - (*p - '0')) / 10)
+        {
+            return NULL;
+        }
+        num = num * 10 + (*p - '0');
+        p++;
     }
 
-
-    assert(0 && "Invalid opcode");
-    return 0;
+    *value = negative ? -num : num;
+    return p;
 }
 
-static void
-split_opcode_from_insn_string(char *buffer, char tokens[2][128])
+/* Length of the operand token starting at p, up to a comma or blank */
+static int
+operand_length(const char *p, const char *end)
 {
-    int token_num = 0;
+    const char *start = p;
 
-    char *token = strtok(buffer, " ");
-
-    while (token != NULL)
+    while (p < end && *p != ',' && !is_blank(*p))
     {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, " ");
+        p++;
     }
+
+    return p - start;
 }
 
 /*
  * This function is related to parsing input file
  *
- * Note : you can edit this function to add new instructions
+ * Parses the instruction in [p, end), which holds no comment and no line
+ * break. Note : you can edit this function to add new instructions
+ *
+ * Returns FALSE, after reporting file, line and token, if the line does not
+ * hold a well formed APEX instruction.
  */
-static void
-create_APEX_instruction(APEX_Instruction *ins, char *buffer)
+static int
+create_APEX_instruction(APEX_Instruction *ins, const char *p, const char *end,
+                        const char *filename, int line_no)
 {
-    int i, token_num = 0;
-    char tokens[6][128];
-    char top_level_tokens[2][128];
+    const char *mnemonic = p;
+    int operands[MAX_OPERANDS] = {0};
+    const char *tokens[MAX_OPERANDS];
+    char prefixes[MAX_OPERANDS];
+    const char *kinds = "";
+    int num_operands = 0;
+    int needed = 0;
+    int i;
+
+    while (p < end && !is_blank(*p))
+    {
+        p++;
+    }
 
-    for (i = 0; i < 2; ++i)
+    ins->opcode = APEX_opcode_lookup(mnemonic, p - mnemonic);
+    if (ins->opcode < 0)
     {
-        strcpy(top_level_tokens[i], "");
+        fprintf(stderr, "APEX_Error: %s:%d: unknown instruction '%.*s'\n", filename, line_no,
+                (int)(p - mnemonic), mnemonic);
+        return FALSE;
     }
 
-    split_opcode_from_insn_string(buffer, top_level_tokens);
+    /* Comma separated operands, blanks allowed around each */
+    while (TRUE)
+    {
+        const char *operand;
 
-    char *token = strtok(top_level_tokens[1], ",");
+        while (p < end && is_blank(*p))
+        {
+            p++;
+        }
 
-    while (token != NULL)
-    {
-        strcpy(tokens[token_num], token);
-        token_num++;
-        token = strtok(NULL, ",");
-    }
+        if (p == end)
+        {
+            break;
+        }
 
-    strcpy(ins->opcode_str, top_level_tokens[0]);
-    ins->opcode = set_opcode_str(ins->opcode_str);
+        operand = p;
+        if (num_operands == MAX_OPERANDS ||
+            !(p = parse_operand(p, end, &prefixes[num_operands], &operands[num_operands])))
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: bad operand '%.*s'\n", filename, line_no,
+                    operand_length(operand, end), operand);
+            return FALSE;
+        }
+        tokens[num_operands++] = operand;
+
+        while (p < end && is_blank(*p))
+        {
+            p++;
+        }
+
+        if (p < end && *p == ',')
+        {
+            p++;
+        }
+        else if (p < end)
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: bad operand '%.*s'\n", filename, line_no,
+                    operand_length(operand, end), operand);
+            return FALSE;
+        }
+    }
 
     switch (ins->opcode)
     {
@@ -201,123 +185,316 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_XOR:
         case OPCODE_LDR:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
+            needed = 3;
+            kinds = "RRR";
+            ins->rd = operands[0];
+            ins->rs1 = operands[1];
+            ins->rs2 = operands[2];
             break;
         }
 
         case OPCODE_MOVC:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->imm = get_num_from_string(tokens[1]);
+            needed = 2;
+            kinds = "R#";
+            ins->rd = operands[0];
+            ins->imm = operands[1];
             break;
         }
 
         case OPCODE_LOAD:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            needed = 3;
+            kinds = "RR#";
+            ins->rd = operands[0];
+            ins->rs1 = operands[1];
+            ins->imm = operands[2];
             break;
         }
 
         case OPCODE_STORE:
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            needed = 3;
+            kinds = "RR#";
+            ins->rs1 = operands[0];
+            ins->rs2 = operands[1];
+            ins->imm = operands[2];
             break;
         }
 
         case OPCODE_BZ:
         case OPCODE_BNZ:
         {
-            ins->imm = get_num_from_string(tokens[0]);
+            needed = 1;
+            kinds = "#";
+            ins->imm = operands[0];
             break;
         }
 
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
-            ins->rd = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->imm = get_num_from_string(tokens[2]);
+            needed = 3;
+            kinds = "RR#";
+            ins->rd = operands[0];
+            ins->rs1 = operands[1];
+            ins->imm = operands[2];
             break;
         }
 
         case OPCODE_CMP:
         {
-            ins->rs1 = get_num_from_string(tokens[0]);
-            ins->rs2 = get_num_from_string(tokens[1]);
+            needed = 2;
+            kinds = "RR";
+            ins->rs1 = operands[0];
+            ins->rs2 = operands[1];
             break;
         }
 
         case OPCODE_STR:
         {
-            ins->rs3 = get_num_from_string(tokens[0]);
-            ins->rs1 = get_num_from_string(tokens[1]);
-            ins->rs2 = get_num_from_string(tokens[2]);
+            needed = 3;
+            kinds = "RRR";
+            ins->rs3 = operands[0];
+            ins->rs1 = operands[1];
+            ins->rs2 = operands[2];
             break;
         }
 
     }
     /* Fill in rest of the instructions accordingly */
+
+    if (num_operands != needed)
+    {
+        fprintf(stderr, "APEX_Error: %s:%d: %s takes %d operands, got %d\n", filename,
+                line_no, APEX_op_info[ins->opcode].mnemonic, needed, num_operands);
+        return FALSE;
+    }
+
+    /* Registers where the instruction takes registers, literals where it
+     * takes literals */
+    for (i = 0; i < num_operands; ++i)
+    {
+        if (prefixes[i] != kinds[i] ||
+            (kinds[i] == 'R' && (operands[i] < 0 || operands[i] >= REG_FILE_SIZE)))
+        {
+            fprintf(stderr, "APEX_Error: %s:%d: bad operand '%.*s'\n", filename, line_no,
+                    operand_length(tokens[i], end), tokens[i]);
+            return FALSE;
+        }
+    }
+
+    /* The registers are in range by now, so only the literal can fail to
+     * fit its field */
+    if (!APEX_encode_word(ins, &ins->word))
+    {
+        const char *literal = strchr(kinds, '#') ? tokens[strchr(kinds, '#') - kinds] : end;
+
+        fprintf(stderr, "APEX_Error: %s:%d: %s operand out of range '%.*s'\n", filename,
+                line_no, APEX_op_info[ins->opcode].mnemonic, operand_length(literal, end),
+                literal);
+        return FALSE;
+    }
+
+    return TRUE;
 }
 
 /*
- * This function is related to parsing input file
- *
- * Note : You are not supposed to edit this function
+ * Parses the program text in [text, text + length) into a new code memory.
+ * Returns NULL, with *size set to the instructions parsed so far, if the
+ * text has no instruction or holds an error.
  */
-APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+static APEX_Instruction *
+parse_program(const char *text, size_t length, const char *filename, int *size)
 {
-    FILE *fp;
-    ssize_t nread;
-    size_t len = 0;
-    char *line = NULL;
+    const char *p = text;
+    const char *end = text + length;
     int code_memory_size = 0;
-    int current_instruction = 0;
+    int capacity = INITIAL_CODE_MEMORY;
+    int line_no = 0;
     APEX_Instruction *code_memory;
 
-    if (!filename)
+    code_memory = malloc(capacity * sizeof(APEX_Instruction));
+    if (!code_memory)
     {
         return NULL;
     }
 
-    fp = fopen(filename, "r");
-    if (!fp)
+    while (p < end)
     {
-        return NULL;
-    }
+        const char *line_end = memchr(p, '\n', end - p);
+        const char *next = line_end ? line_end + 1 : end;
+        const char *comment;
+
+        line_no++;
+        if (!line_end)
+        {
+            line_end = end;
+        }
+
+        comment = memchr(p, ';', line_end - p);
+        if (comment)
+        {
+            line_end = comment;
+        }
+
+        while (p < line_end && is_blank(*p))
+        {
+            p++;
+        }
+        while (line_end > p && is_blank(line_end[-1]))
+        {
+            line_end--;
+        }
+
+        if (p == line_end || *p == '#')
+        {
+            p = next;
+            continue;
+        }
+
+        if (code_memory_size == capacity)
+        {
+            APEX_Instruction *grown;
+
+            capacity *= 2;
+            grown = realloc(code_memory, capacity * sizeof(APEX_Instruction));
+            if (!grown)
+            {
+                break;
+            }
+            code_memory = grown;
+        }
+
+        memset(&code_memory[code_memory_size], 0, sizeof(APEX_Instruction));
+        if (!create_APEX_instruction(&code_memory[code_memory_size], p, line_end, filename,
+                                     line_no))
+        {
+            break;
+        }
 
-    while ((nread = getline(&line, &len, fp)) != -1)
-    {
         code_memory_size++;
+        p = next;
     }
+
     *size = code_memory_size;
-    if (!code_memory_size)
+    if (p < end || !code_memory_size)
     {
-        fclose(fp);
+        free(code_memory);
         return NULL;
     }
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    return code_memory;
+}
+
+/* Maps filename read-only. Returns FALSE if it cannot be read or is empty */
+static int
+map_file(const char *filename, void **text, size_t *length)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        return FALSE;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
+    {
+        close(fd);
+        return FALSE;
+    }
+
+    *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*text == MAP_FAILED)
+    {
+        return FALSE;
+    }
+
+    *length = st.st_size;
+    madvise(*text, *length, MADV_SEQUENTIAL);
+    return TRUE;
+}
+
+/*
+ * This function is related to parsing input file
+ *
+ * filename may hold program text or an image written by APEX_assemble. Text
+ * is taken from the assembled program cache when it has been parsed before.
+ *
+ * Returns the code memory of the program in filename and its number of
+ * instructions in *size, or NULL if the file cannot be read or parsed.
+ */
+APEX_Instruction *
+create_code_memory(const char *filename, int *size)
+{
+    void *text;
+    size_t length;
+    APEX_Instruction *code_memory;
+
+    *size = 0;
+    if (!filename || !map_file(filename, &text, &length))
     {
-        fclose(fp);
         return NULL;
     }
 
-    rewind(fp);
-    while ((nread = getline(&line, &len, fp)) != -1)
+    if (APEX_image_check(text, length))
+    {
+        code_memory = APEX_image_decode(text, length, filename, size);
+    }
+    else if (!(code_memory = APEX_image_cache_load(text, length, size)))
+    {
+        code_memory = parse_program(text, length, filename, size);
+        if (code_memory)
+        {
+            APEX_image_cache_store(text, length, code_memory, *size);
+        }
+    }
+    munmap(text, length);
+
+    if (code_memory && !APEX_predecode(code_memory, *size))
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
-        current_instruction++;
+        free(code_memory);
+        return NULL;
     }
 
-    free(line);
-    fclose(fp);
     return code_memory;
-}
\ No newline at end of file
+}
+
+/*
+ * Parses the program text in source and writes it as a binary image to
+ * image, which later loads in place of the text.
+ *
+ * Returns the number of instructions assembled, or -1 on error.
+ */
+int
+APEX_assemble(const char *source, const char *image)
+{
+    void *text;
+    size_t length;
+    APEX_Instruction *code_memory;
+    int size = 0;
+
+    if (!map_file(source, &text, &length))
+    {
+        fprintf(stderr, "APEX_Error: Unable to read %s\n", source);
+        return -1;
+    }
+
+    code_memory = parse_program(text, length, source, &size);
+    if (code_memory && !APEX_image_write(image, code_memory, size, text, length))
+    {
+        fprintf(stderr, "APEX_Error: Unable to write %s\n", image);
+        size = -1;
+    }
+    else if (!code_memory)
+    {
+        size = -1;
+    }
+
+    munmap(text, length);
+    free(code_memory);
+    return size;
+}
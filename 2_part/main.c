@@ -11,13 +11,84 @@
 
 #include "apex_cpu.h"
 
+/* Prints the architectural state at the end of a Simulate-style run */
+static void
+print_final_state(APEX_CPU *cpu)
+{
+    print_reg_file(cpu);
+    printf("================STATE OF DATA MEMORY==================\n");
+
+    for(int i = 0; i < DATA_MEMORY_SIZE; i=i+4){
+
+        printf("MEM[%d] : %d\n", i, cpu->data_memory[i]);
+    }
+}
+
+/* Configuration given by the -c and -o options */
+static APEX_Config config;
+
+/* APEX_cpu_init with the command line configuration applied, or NULL if
+ * either fails */
+static APEX_CPU *
+create_cpu(const char *filename, int printMsg)
+{
+    APEX_CPU *cpu = APEX_cpu_init(filename, printMsg);
+
+    if (cpu && !APEX_cpu_configure(cpu, &config))
+    {
+        APEX_cpu_stop(cpu);
+        cpu = NULL;
+    }
+
+    return cpu;
+}
+
 int
 main(int argc, char *argv[])
 {
     APEX_CPU *cpu;
+    const char *prog = argv[0];
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
+    /* Leading options, applied in order: -c <config_file>, -o <key>=<value> */
+    APEX_config_default(&config);
+    while (argc > 2 && argv[1][0] == '-')
+    {
+        if (strcmp(argv[1], "-c") == 0)
+        {
+            if (!APEX_config_load(&config, argv[2]))
+            {
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[1], "-o") == 0)
+        {
+            if (!APEX_config_set(&config, argv[2]))
+            {
+                exit(1);
+            }
+        }
+        else
+        {
+            break;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (!APEX_config_check(&config))
+    {
+        exit(1);
+    }
+
+    if (argc < 3)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s [-c <config_file>] [-o <key>=<value>] "
+                "<input_file> <command> [<args>]\n", prog);
+        exit(1);
+    }
+
    /*if (argc != 2)
     {
         fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
@@ -26,7 +97,7 @@ main(int argc, char *argv[])
 
     if(strcasecmp(argv[2], "Initialize") == 0){
         
-        cpu = APEX_cpu_init(argv[1], 1);
+        cpu = create_cpu(argv[1], 1);
         if (!cpu)
         {
            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
@@ -37,26 +108,181 @@ main(int argc, char *argv[])
         }
     }else if(strcasecmp(argv[2],"Simulate") == 0){
         
-        cpu = APEX_cpu_init(argv[1], 0);
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
         cpu->single_step = 0;
         APEX_cpu_simulate(cpu, atoi(argv[3]));
-        print_reg_file(cpu);
-        printf("================STATE OF DATA MEMORY==================\n");
+        print_final_state(cpu);
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Stats") == 0){
 
-        for(int i = 0; i < DATA_MEMORY_SIZE; i=i+4){
+        /* Like Simulate, followed by fetch, issue, functional unit occupancy,
+         * operand forwarding, branch prediction, cache, prefetcher, memory,
+         * load/store queue and out-of-order core statistics */
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        cpu->single_step = 0;
+        APEX_cpu_simulate(cpu, argc > 3 ? atoi(argv[3]) : 0);
+        APEX_cpu_print_fetch_stats(cpu);
+        APEX_cpu_print_issue_stats(cpu);
+        APEX_cpu_print_fu_stats(cpu);
+        APEX_cpu_print_forwarding_stats(cpu);
+        APEX_bpred_print_stats(&cpu->bpred, cpu->insn_completed);
+        APEX_cache_print_stats(&cpu->icache, "INSTRUCTION CACHE");
+        APEX_cache_print_stats(&cpu->dcache, "DATA CACHE");
+        APEX_prefetch_print_stats(&cpu->prefetch, &cpu->dcache);
+        APEX_memory_print_stats(&cpu->memory);
+        APEX_cpu_print_lsq_stats(cpu);
+        APEX_cpu_print_ooo_stats(cpu);
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Predictors") == 0){
 
-            printf("MEM[%d] : %d\n", i, cpu->data_memory[i]);            
+        /* Simulate argv[3] cycles while the predictors listed in argv[4]
+         * (all by default) predict the same branches */
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        cpu->single_step = 0;
+        if (!APEX_bpred_sweep(cpu, argc > 3 ? atoi(argv[3]) : 0, argc > 4 ? argv[4] : NULL))
+        {
+           exit(1);
+        }
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Widths") == 0){
 
-            /*if(cpu->data_memory[i] > 0){
-              
-               printf("MEM[%d] : %d\n", i, cpu->data_memory[i]);            
-            }*/
+        /* Simulate argv[3] cycles at every issue width and compare IPC */
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        cpu->single_step = 0;
+        if (!APEX_cpu_width_sweep(cpu, argc > 3 ? atoi(argv[3]) : 0))
+        {
+           exit(1);
         }
         APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Caches") == 0){
+
+        /* Simulate argv[3] cycles and report the data cache miss ratio of
+         * many cache sizes and associativities */
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        cpu->single_step = 0;
+        if (!APEX_cache_sweep(cpu, argc > 3 ? atoi(argv[3]) : 0))
+        {
+           exit(1);
+        }
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"FastForward") == 0){
+
+        /* Skip argv[3] instructions functionally, then simulate argv[4] cycles */
+        if (argc < 4)
+        {
+           fprintf(stderr, "APEX_Help: Usage %s <input_file> FastForward <instructions> "
+                   "[<cycles>]\n", prog);
+           exit(1);
+        }
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        cpu->single_step = 0;
+        int status = APEX_cpu_fast_forward(cpu, atoi(argv[3]));
+        if (status == APEX_SIM_FAULT)
+        {
+           fprintf(stderr, "APEX_Error: Fast-forward stopped by a fault at pc(%d)\n", cpu->pc);
+           APEX_cpu_stop(cpu);
+           exit(1);
+        }
+        printf("APEX_CPU: Fast-forwarded %d instructions\n", cpu->insn_fast_forwarded);
+        if (status == APEX_SIM_INSN_LIMIT)
+        {
+            printf("APEX_CPU: Detailed simulation starts at pc(%d)\n", cpu->pc);
+            APEX_cpu_simulate(cpu, argc > 4 ? atoi(argv[4]) : 0);
+        }
+        else if (status == APEX_SIM_HALTED)
+        {
+            printf("APEX_CPU: HALT reached while fast-forwarding\n");
+        }
+        print_final_state(cpu);
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Sample") == 0){
+
+        /* Every argv[3] instructions, warm up argv[4] and measure argv[5] */
+        APEX_Sample_Stats stats;
+
+        if (argc < 6)
+        {
+           fprintf(stderr, "APEX_Help: Usage %s <input_file> Sample <period> <warmup> <measure>\n",
+                   prog);
+           exit(1);
+        }
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        if (APEX_cpu_sample(cpu, atoi(argv[3]), atoi(argv[4]), atoi(argv[5]), &stats) ==
+            APEX_SIM_FAULT)
+        {
+           fprintf(stderr, "APEX_Error: Sampling stopped by a fault at pc(%d)\n", cpu->pc);
+           APEX_cpu_stop(cpu);
+           exit(1);
+        }
+        printf("APEX_CPU: Sampling Complete, instructions = %d samples = %d dropped = %d\n",
+               stats.instructions, stats.samples, stats.windows_dropped);
+        printf("APEX_CPU: CPI = %.4f +/- %.4f (95%% confidence), estimated cycles = %.0f\n",
+               stats.cpi_mean, stats.cpi_ci95, stats.est_cycles);
+        print_final_state(cpu);
+        APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Functional") == 0){
+
+        /* Architectural state only, argv[3] optionally limits instructions */
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        if (APEX_functional_run(cpu, argc > 3 ? atoi(argv[3]) : 0) == APEX_SIM_HALTED)
+        {
+            printf("APEX_CPU: Functional Simulation Complete, instructions = %d\n", cpu->insn_completed);
+        }
+        else
+        {
+            printf("APEX_CPU: Functional Simulation Stopped, instructions = %d\n", cpu->insn_completed);
+        }
+        print_final_state(cpu);
+        APEX_cpu_stop(cpu);
     }else if(strcasecmp(argv[2],"Single_Step") == 0){
         
-        cpu = APEX_cpu_init(argv[1], 0);
-        APEX_cpu_single_step(cpu, 0);
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
+        APEX_cpu_display(cpu, 0);
         print_reg_file(cpu);
         printf("==========STATE OF DATA MEMORY==============\n");
 
@@ -75,16 +301,26 @@ main(int argc, char *argv[])
         APEX_cpu_stop(cpu);
     }else if(strcasecmp(argv[2],"ShowMem") == 0){
         
-        cpu = APEX_cpu_init(argv[1], 0);
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
         cpu->single_step = 0;
-        APEX_cpu_show_mem(cpu, 0);
+        APEX_cpu_simulate(cpu, 0);
         printf("==========STATE OF DATA MEMORY==============\n");
         printf("MEM[%d] : %d\n", atoi(argv[3]), cpu->data_memory[atoi(argv[3])]);
         //printf("--------------------------------------------\n");
         APEX_cpu_stop(cpu);
     }else if(strcasecmp(argv[2],"Display") == 0){
         
-        cpu = APEX_cpu_init(argv[1], 0);
+        cpu = create_cpu(argv[1], 0);
+        if (!cpu)
+        {
+           fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+           exit(1);
+        }
         cpu->single_step = 0;
         APEX_cpu_display(cpu, atoi(argv[3]));
         /*printf("--------------------------------------------\n");
@@ -108,8 +344,28 @@ main(int argc, char *argv[])
         }
         printf("--------------------------------------------\n");
         APEX_cpu_stop(cpu);
+    }else if(strcasecmp(argv[2],"Assemble") == 0){
+
+        /* Writes argv[1] as a binary image to argv[3] */
+        int size;
+
+        if (argc < 4)
+        {
+           fprintf(stderr, "APEX_Help: Usage %s <input_file> Assemble <image_file>\n", prog);
+           exit(1);
+        }
+        size = APEX_assemble(argv[1], argv[3]);
+        if (size < 0)
+        {
+           exit(1);
+        }
+        printf("APEX_CPU: Assembled %d instructions into %s\n", size, argv[3]);
+    }else if(strcasecmp(argv[2],"Batch") == 0){
+
+        /* argv[1] is a manifest of jobs, argv[3] the optional thread count */
+        return APEX_batch_run(argv[1], argc > 3 ? atoi(argv[3]) : 0, &config);
     }else{
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", prog);
         exit(1);
     }
 